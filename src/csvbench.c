@@ -0,0 +1,280 @@
+/**
+ * @file csvbench.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Tokenizer microbenchmark: strtok_quotes() against csv_scan().
+ * @version 0.1
+ * @date 2025-04-18
+ *
+ * Splits the rows of a songs CSV into fields, once the way parse_line() does
+ * (a line at a time, strtok() and strtok_quotes() plus clean_str() on every
+ * token) and once from the separator offsets csv_scan() finds with each
+ * classifier this CPU supports. Only the splitting is timed: no numbers or
+ * dates are converted and no records are built. Without a file, a synthetic
+ * one of -n rows is generated in memory, with quoted names holding commas.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "spotify.h"
+#include "sscan.h"
+
+// Longest row the strtok() path copies out of the buffer (as fgets() would)
+#define LINE_MAX_BYTES 2048
+
+// Bytes handed to csv_scan() at a time, as scsv.c does
+#define SCAN_WINDOW (1u << 18)
+
+// Columns in a row, and the ones parse_line() reads with strtok_quotes()
+#define NUM_FIELDS 23
+static const int quoted_field[NUM_FIELDS] = { [1] = 1, [2] = 1, [5] = 1, [7] = 1 };
+
+static const char *words[] = {
+    "Love", "Night", "Summer", "Dance", "Heart", "City", "Girl", "Boy", "Dream", "Fire",
+    "Gold", "Sky", "Road", "Light", "Baby", "One", "Feat", "Remix", "Live", "Edit"
+};
+static const char *genres[] = { "pop", "rock", "rap", "latin", "r&b", "edm" };
+
+struct tally {
+    long rows;
+    long fields;
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_rand(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+static void put_id(char **out, uint64_t *state) {
+    static const char alphabet[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    for (int i = 0; i < 22; i++) {
+        *(*out)++ = alphabet[next_rand(state) % 62];
+    }
+    *(*out)++ = ',';
+}
+
+/**
+ * @brief A few words; every fourth name is quoted and has commas in it.
+ */
+static void put_name(char **out, uint64_t *state) {
+    int quoted = next_rand(state) % 4 == 0;
+    int n = 2 + (int)(next_rand(state) % 4);
+    if (quoted) *(*out)++ = '"';
+    for (int i = 0; i < n; i++) {
+        if (i > 0) {
+            *out += sprintf(*out, quoted && next_rand(state) % 2 ? ", " : " ");
+        }
+        *out += sprintf(*out, "%s", words[next_rand(state) % (sizeof(words) / sizeof(words[0]))]);
+    }
+    if (quoted) *(*out)++ = '"';
+    *(*out)++ = ',';
+}
+
+/**
+ * @brief A header and rows of synthetic songs, in the column order of the
+ * real file.
+ */
+static char *make_csv(long rows, size_t *size) {
+    char *buf = (char *)malloc((size_t)rows * 400 + 1024);
+    if (!buf) {
+        return NULL;
+    }
+    char *out = buf;
+    out += sprintf(out, "track_id,track_name,track_artist,track_popularity,track_album_id,"
+                        "track_album_name,track_album_release_date,playlist_name,playlist_id,"
+                        "playlist_genre,playlist_subgenre,danceability,energy,key,loudness,mode,"
+                        "speechiness,acousticness,instrumentalness,liveness,valence,tempo,duration_ms\n");
+    uint64_t state = 42;
+    for (long r = 0; r < rows; r++) {
+        put_id(&out, &state);
+        put_name(&out, &state);
+        put_name(&out, &state);
+        out += sprintf(out, "%d,", (int)(next_rand(&state) % 101));
+        put_id(&out, &state);
+        put_name(&out, &state);
+        out += sprintf(out, "%d-%02d-%02d,", 1960 + (int)(next_rand(&state) % 60),
+                       1 + (int)(next_rand(&state) % 12), 1 + (int)(next_rand(&state) % 28));
+        put_name(&out, &state);
+        put_id(&out, &state);
+        const char *genre = genres[next_rand(&state) % (sizeof(genres) / sizeof(genres[0]))];
+        out += sprintf(out, "%s,%s %s,", genre, words[next_rand(&state) % 20], genre);
+        for (int i = 0; i < 11; i++) {
+            out += sprintf(out, "%d.%04d,", (int)(next_rand(&state) % 2), (int)(next_rand(&state) % 10000));
+        }
+        out += sprintf(out, "%d\n", 60000 + (int)(next_rand(&state) % 300000));
+    }
+    *size = (size_t)(out - buf);
+    return buf;
+}
+
+static char *read_file(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror("Error opening file");
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = len >= 0 ? (char *)malloc((size_t)len + 1) : NULL;
+    if (!buf || fread(buf, 1, (size_t)len, fp) != (size_t)len) {
+        perror("Error reading file");
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    *size = (size_t)len;
+    return buf;
+}
+
+/**
+ * @brief Split every row after the header the way parse_line() does.
+ */
+static struct tally split_strtok(const char *data, size_t size) {
+    struct tally t = { 0, 0 };
+    char line[LINE_MAX_BYTES];
+    const char *end = data + size;
+    const char *p = (const char *)memchr(data, '\n', size);
+    p = p ? p + 1 : end;
+
+    while (p < end) {
+        const char *nl = (const char *)memchr(p, '\n', (size_t)(end - p));
+        const char *next = nl ? nl + 1 : end;
+        size_t len = (size_t)(next - p);
+        if (len > sizeof(line) - 1) {
+            len = sizeof(line) - 1;
+        }
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p = next;
+
+        // A short row stops at the first missing field, as parse_line() does
+        char *token = strtok(line, ",");
+        int f = 0;
+        while (token) {
+            clean_str(token);
+            t.fields++;
+            if (++f == NUM_FIELDS) {
+                t.rows++;
+                break;
+            }
+            token = quoted_field[f] ? strtok_quotes(NULL, ",") : strtok(NULL, ",");
+        }
+    }
+    return t;
+}
+
+/**
+ * @brief Split every row after the header at the separators csv_scan() finds.
+ */
+static struct tally split_scan(const char *data, size_t size, enum scan_impl impl, uint32_t *seps) {
+    struct tally t = { 0, 0 };
+    const char *end = data + size;
+    const char *p = (const char *)memchr(data, '\n', size);
+    p = p ? p + 1 : end;
+
+    while (p < end) {
+        size_t len = (size_t)(end - p) < SCAN_WINDOW ? (size_t)(end - p) : SCAN_WINDOW;
+        size_t n = csv_scan(p, len, seps, impl);
+        const char *row = p;
+        long fields = 0;
+        for (size_t i = 0; i < n; i++) {
+            fields++;
+            if (p[seps[i]] == '\n') {
+                t.rows++;
+                t.fields += fields;
+                fields = 0;
+                row = p + seps[i] + 1;
+            }
+        }
+        if (p + len == end || row == p) {
+            break;
+        }
+        p = row;
+    }
+    return t;
+}
+
+static void report(const char *name, double best, size_t size, struct tally t) {
+    printf("%-8s %8.1f ms %8.1f MB/s %10.1f Mrows/s  (%ld rows, %ld fields)\n", name, best * 1e3,
+           size / best / 1e6, t.rows / best / 1e6, t.rows, t.fields);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n ROWS] [-r RUNS] [FILE]\n", prog);
+    fprintf(stderr, "  Times splitting FILE (or ROWS synthetic rows, default 2000000) into fields\n");
+    fprintf(stderr, "  and reports the best of RUNS (default 3) for each tokenizer\n");
+}
+
+int main(int argc, char *argv[]) {
+    long rows = 2000000;
+    int runs = 3;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            rows = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rows <= 0 || runs <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t size = 0;
+    char *data = path ? read_file(path, &size) : make_csv(rows, &size);
+    uint32_t *seps = (uint32_t *)malloc(SCAN_WINDOW * sizeof(uint32_t));
+    if (!data || !seps) {
+        fprintf(stderr, "Error: cannot set up the input\n");
+        return 2;
+    }
+    printf("%s: %.1f MB\n", path ? path : "synthetic", size / 1e6);
+
+    static const struct {
+        const char *name;
+        enum scan_impl impl;
+    } scanners[] = {
+        { "scalar", SCAN_SCALAR }, { "sse2", SCAN_SSE2 }, { "avx2", SCAN_AVX2 }
+    };
+
+    // strtok() path first (index -1), then each classifier the CPU has
+    for (int s = -1; s < (int)(sizeof(scanners) / sizeof(scanners[0])); s++) {
+        if (s >= 0 && !scan_supported(scanners[s].impl)) {
+            printf("%-8s unsupported on this CPU\n", scanners[s].name);
+            continue;
+        }
+        double best = 0;
+        struct tally t = { 0, 0 };
+        for (int r = 0; r < runs; r++) {
+            double start = now();
+            t = s < 0 ? split_strtok(data, size) : split_scan(data, size, scanners[s].impl, seps);
+            double elapsed = now() - start;
+            if (r == 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        report(s < 0 ? "strtok" : scanners[s].name, best, size, t);
+    }
+
+    free(seps);
+    free(data);
+    return 0;
+}
@@ -5,68 +5,77 @@
 #include <stdbool.h>
 #include <string.h>
 
-#include "snode.h"
-#include "slist.h"
 #include "htable.h"
 
-/**
- * @brief compare two key-value pairs by key.
- * 
- * @param a 
- * @param b 
- * @return int 
- */
-int compare_key(const void *a, const void *b) {
-	if (strcmp((char *)a, (char *)b) == 0){
-		return 0;
-	}
-	return 1;
-}
+// Grow once the table is this full (numerator over 8)
+#define HTABLE_MAX_LOAD 7
+#define HTABLE_MIN_SIZE 8
 
-int compare_key_struct(const void *a, const void *b) {
-	if (strcmp((((struct kv_pair *)a)->key), (char *)b) == 0){
-		return 0;
-	}
-	return 1;
-}
+// Elements moved out of the old slot array by every insert or delete during a rehash.
+// A rehash starts with 7/16 of the new capacity left to move, and the next one is only
+// due after that many more inserts, so even 1 would finish in time; 4 keeps it short.
+#define HTABLE_MIGRATE_STEP 4
 
 // djb2 hash function for a string
 // does not need to be modified
 int hash(const char *key) {
 	int hash = 5381;
 	for (size_t i = 0; key[i] != '\0'; i++) {
-	
+
 		hash = ((hash << 5) + hash) + key[i];
 	}
 	return hash;
 }
 
+/**
+ * @brief djb2 mixes poorly into its low bits, which are the ones a power-of-two table uses,
+ * so finish it with the murmur3 avalanche step.
+ */
+static uint32_t hash_key(const char *key) {
+	uint32_t h = (uint32_t)hash(key);
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+static uint32_t round_up_pow2(uint32_t n) {
+	uint32_t size = HTABLE_MIN_SIZE;
+	while (size < n) {
+		size <<= 1;
+	}
+	return size;
+}
+
 struct htable *htable_create(uint32_t size) {
 	// Allocate memory for hashmap struct
 	struct htable *hashmap = (struct htable *) malloc(sizeof(struct htable));
-	// Allocate memory for table of pointers in hashmap
-	// table will need size * number of pointers = size * (struct slist*)
-	hashmap->table = (struct slist **) malloc(size * sizeof(struct slist*));
-	// Create lists in table array (allocate memory for each list)
-	for (uint32_t i = 0; i < size; i++) {
-		hashmap->table[i] = slist_create();
+	if (!hashmap) {
+		return NULL;
+	}
+
+	// Leave room for size elements below the load limit
+	hashmap->size = round_up_pow2(size + size / HTABLE_MAX_LOAD + 1);
+	hashmap->slots = (struct htable_slot *) calloc(hashmap->size, sizeof(struct htable_slot));
+	if (!hashmap->slots) {
+		free(hashmap);
+		return NULL;
 	}
-	hashmap->size = size;
 	hashmap->num_elems = 0;
+	hashmap->old_slots = NULL;
+	hashmap->old_size = 0;
+	hashmap->old_elems = 0;
+	hashmap->migrate_pos = 0;
 	return hashmap;
 }
 
 // Destroys overarching structures
-void htable_destroy(struct htable *ht) {	
-	
-	// Deallocate all lists
-	for (uint32_t i = 0; i < ht->size; i++) {
-		struct slist *list = ht->table[i];
-		slist_destroy(list, 1);
-	}
-
-	// Deallocate table of pointers
-	free(ht->table);
+void htable_destroy(struct htable *ht) {
+	// The pairs live inside the slot arrays, so this releases them all
+	free(ht->slots);
+	free(ht->old_slots);
 
 	// Dealocate htable struct
 	free(ht);
@@ -74,109 +83,241 @@ void htable_destroy(struct htable *ht) {
 	return;
 }
 
-void* htable_find(struct htable *ht, const char *key) {
-	// Hash the key
-	int key_hash = hash(key) % ht->size;
+/**
+ * @brief find the slot holding key in one slot array, or NULL. probing stops at an empty slot or at an
+ * element closer to its home than we are to ours, since Robin Hood insertion would have placed key
+ * before it.
+ */
+static struct htable_slot *slots_lookup(struct htable_slot *slots, uint32_t size, const char *key, uint32_t h) {
+	uint32_t mask = size - 1;
+
+	for (uint32_t i = h & mask, dist = 0; ; i = (i + 1) & mask, dist++) {
+		struct htable_slot *slot = &slots[i];
+		if (slot->kv.key == NULL || slot->dist < dist) {
+			return NULL;
+		}
+		if (slot->hash == h && strcmp(slot->kv.key, key) == 0) {
+			return slot;
+		}
+	}
+}
 
-	// Find corresponding bucket in hash table
-	struct slist *bucket = ht->table[key_hash];
+/**
+ * @brief place a pair known not to be in the array, starting at slot i (cur.dist slots from its home)
+ * and displacing richer elements on the way.
+ */
+static void slots_place_at(struct htable_slot *slots, uint32_t size, uint32_t i, struct htable_slot cur) {
+	uint32_t mask = size - 1;
+
+	for (; ; i = (i + 1) & mask, cur.dist++) {
+		struct htable_slot *slot = &slots[i];
+		if (slot->kv.key == NULL) {
+			*slot = cur;
+			return;
+		}
+		if (slot->dist < cur.dist) {
+			struct htable_slot tmp = *slot;
+			*slot = cur;
+			cur = tmp;
+		}
+	}
+}
 
-	struct kv_pair *data = (struct kv_pair *) slist_find_value(bucket, (void *)key, compare_key_struct);
+static void slots_place(struct htable_slot *slots, uint32_t size, struct htable_slot cur) {
+	cur.dist = 0;
+	slots_place_at(slots, size, cur.hash & (size - 1), cur);
+}
 
-	if (data != NULL) {
-		void *r_val = data->value;
+/**
+ * @brief empty slot i. backward-shift deletion: pull the following elements one slot closer to home
+ * until one is already home (or the run ends), so no tombstones are needed.
+ */
+static void slots_remove(struct htable_slot *slots, uint32_t size, uint32_t i) {
+	uint32_t mask = size - 1;
+
+	for (;;) {
+		uint32_t next = (i + 1) & mask;
+		if (slots[next].kv.key == NULL || slots[next].dist == 0) {
+			memset(&slots[i], 0, sizeof(struct htable_slot));
+			return;
+		}
+		slots[i] = slots[next];
+		slots[i].dist--;
+		i = next;
+	}
+}
 
-		if (r_val != NULL) {
-			return r_val;
+/**
+ * @brief move up to max_moves elements from the old slot array into the current one.
+ * the old array stays a valid table after every move, so it can still be searched.
+ */
+static void htable_migrate(struct htable *ht, uint32_t max_moves) {
+	uint32_t mask = ht->old_size - 1;
+
+	while (ht->old_elems > 0 && max_moves > 0) {
+		struct htable_slot *slot = &ht->old_slots[ht->migrate_pos];
+		if (slot->kv.key == NULL) {
+			ht->migrate_pos = (ht->migrate_pos + 1) & mask;
+			continue;
 		}
+		// Removing may shift the next element into this slot, so stay put
+		slots_place(ht->slots, ht->size, *slot);
+		slots_remove(ht->old_slots, ht->old_size, ht->migrate_pos);
+		ht->old_elems--;
+		max_moves--;
+	}
+
+	if (ht->old_elems == 0 && ht->old_slots != NULL) {
+		free(ht->old_slots);
+		ht->old_slots = NULL;
+		ht->old_size = 0;
+		ht->migrate_pos = 0;
+	}
+}
+
+/**
+ * @brief start moving into a slot array twice the size (finishing any earlier rehash first).
+ */
+static bool htable_grow(struct htable *ht) {
+	htable_migrate(ht, UINT32_MAX);
+
+	struct htable_slot *slots = (struct htable_slot *) calloc((size_t)ht->size * 2, sizeof(struct htable_slot));
+	if (!slots) {
+		return false;
+	}
+	ht->old_slots = ht->slots;
+	ht->old_size = ht->size;
+	ht->old_elems = ht->num_elems;
+	ht->migrate_pos = 0;
+	ht->slots = slots;
+	ht->size *= 2;
+	return true;
+}
+
+/**
+ * @brief find the slot holding key in either slot array, or NULL.
+ *
+ * @param in_old set to whether the slot is in the old array (may be NULL)
+ */
+static struct htable_slot *htable_lookup(struct htable *ht, const char *key, bool *in_old) {
+	uint32_t h = hash_key(key);
+
+	struct htable_slot *slot = slots_lookup(ht->slots, ht->size, key, h);
+	bool old = false;
+	if (slot == NULL && ht->old_slots != NULL) {
+		slot = slots_lookup(ht->old_slots, ht->old_size, key, h);
+		old = slot != NULL;
+	}
+	if (in_old) {
+		*in_old = old;
 	}
+	return slot;
+}
+
+void htable_finish_rehash(struct htable *ht) {
+	htable_migrate(ht, UINT32_MAX);
+}
+
+void* htable_find(struct htable *ht, const char *key) {
+	struct htable_slot *slot = htable_lookup(ht, key, NULL);
+
 	// Value not found so return NULL
-	return NULL;
+	return slot ? slot->kv.value : NULL;
 }
 
 void* htable_del(struct htable *ht, const char *key) {
+	bool in_old;
+	struct htable_slot *slot = htable_lookup(ht, key, &in_old);
+
 	// If key does not exists, then return NULL
-	if (htable_find(ht, key) == NULL) {
+	if (slot == NULL) {
 		return NULL;
-	} 
-
-	// Hash the key
-	int key_hash = hash(key) % ht->size;
+	}
+	void *r_val = slot->kv.value;
 
-	// Find corresponding bucket in hash table
-	struct slist *bucket = ht->table[key_hash];
+	if (in_old) {
+		slots_remove(ht->old_slots, ht->old_size, (uint32_t)(slot - ht->old_slots));
+		ht->old_elems--;
+	} else {
+		slots_remove(ht->slots, ht->size, (uint32_t)(slot - ht->slots));
+	}
 
-	struct kv_pair *data = (struct kv_pair *) slist_remove_value(bucket, (void *)key, compare_key_struct);
+	// Update count
+	ht->num_elems--;
+	htable_migrate(ht, HTABLE_MIGRATE_STEP);
+	return r_val;
+}
 
+struct kv_pair *htable_find_or_insert(struct htable *ht, const char *key, bool *inserted) {
+	uint32_t h = hash_key(key);
+	*inserted = false;
 
-	if (data != NULL) {
-		void *r_val = data->value;
-		free(data);
-		// Update count
-		ht->num_elems--;
+	// Do the growing and rehash work first (the only work that moves slots around),
+	// so the slot we hand back stays put until the next insert or delete.
+	// Keep the load factor at or below HTABLE_MAX_LOAD / 8
+	if ((uint64_t)(ht->num_elems + 1) * 8 > (uint64_t)ht->size * HTABLE_MAX_LOAD && !htable_grow(ht)) {
+		return NULL;
+	}
+	htable_migrate(ht, HTABLE_MIGRATE_STEP);
 
-		if (r_val != NULL) {
-			return r_val;
+	// A key not moved out of the old array yet is only found there
+	if (ht->old_slots != NULL) {
+		struct htable_slot *slot = slots_lookup(ht->old_slots, ht->old_size, key, h);
+		if (slot != NULL) {
+			return &slot->kv;
 		}
 	}
 
-    return NULL; // Key was not found (shouldn't happen due to initial check)
+	// One probe: either we meet the key, or we reach the slot where it belongs
+	uint32_t mask = ht->size - 1;
+	for (uint32_t i = h & mask, dist = 0; ; i = (i + 1) & mask, dist++) {
+		struct htable_slot *slot = &ht->slots[i];
+		if (slot->kv.key == NULL || slot->dist < dist) {
+			// Claim it, pushing its current (richer) occupant further along
+			if (slot->kv.key != NULL) {
+				struct htable_slot displaced = *slot;
+				displaced.dist++;
+				slots_place_at(ht->slots, ht->size, (i + 1) & mask, displaced);
+			}
+			slot->kv.key = key;
+			slot->kv.value = NULL;
+			slot->hash = h;
+			slot->dist = dist;
+
+			// Increase element count
+			ht->num_elems++;
+			*inserted = true;
+			return &slot->kv;
+		}
+		if (slot->hash == h && strcmp(slot->kv.key, key) == 0) {
+			return &slot->kv;
+		}
+	}
 }
 
 bool htable_insert(struct htable *ht, const char *key, void *value) {
-	// If key exists, then return false
-	if (htable_find(ht, key) != NULL) {
-		return false;
-	} 
-
-	// Create kv pair
-	struct kv_pair *data = (struct kv_pair *) malloc(sizeof(struct kv_pair));
-	data->key = key;
-	data->value = value;
-	
-	// Hash the key
-	int key_hash = hash(key) % ht->size;
-
-	// Find corresponding bucket in hash table
-	struct slist *bucket = ht->table[key_hash];
+	bool inserted;
+	struct kv_pair *kv = htable_find_or_insert(ht, key, &inserted);
 
-	// Add to back of bucket/list
-	slist_add_back(bucket, data);
-
-	// Increase element count
-	ht->num_elems++;
-
-	// If successful, return true
+	// If key exists (or there was no memory to add it), then return false
+	if (kv == NULL || !inserted) {
+		return false;
+	}
+	kv->value = value;
 	return true;
 }
 
 void* htable_update(struct htable *ht, const char *key, void *value){
-	// If key does not exists, then return false
-	if (htable_find(ht, key) == NULL) {
-		return false;
-	} 
-
-	// Hash the key
-	int key_hash = hash(key) % ht->size;
-
-	// Find corresponding bucket in hash table
-	struct slist *bucket = ht->table[key_hash];
-
-	// Find node and then update it's value
-	struct snode *node = bucket->front;
-	while (node != NULL) {
-		struct kv_pair *pair = (struct kv_pair *)node->data;
-		if (compare_key(pair->key, key) == 0) {
-			// Inefficient, but need it to pass the test
-			void *r_val = pair->value;
-			pair->value = value;
-			return r_val;
-		}
-		node = node->next;
-	}
+	struct htable_slot *slot = htable_lookup(ht, key, NULL);
 
 	// Node not found, so return NULL
-	return NULL;
+	if (slot == NULL) {
+		return NULL;
+	}
+
+	void *r_val = slot->kv.value;
+	slot->kv.value = value;
+	return r_val;
 }
 
 uint32_t htable_num_elems(struct htable *ht) {
@@ -185,17 +326,21 @@ uint32_t htable_num_elems(struct htable *ht) {
 
 void **htable_values(struct htable *ht) {
 	// Create an array to store values with size of num_elems
-	void **arr = malloc(ht->num_elems * sizeof(void *));
+	void **arr = malloc((ht->num_elems > 0 ? ht->num_elems : 1) * sizeof(void *));
+	if (!arr) {
+		return NULL;
+	}
 	uint32_t idx = 0;
 
-	// Go through every bucket and the nodes, saving the kv pair in the arr
+	// Go through every occupied slot of both arrays, saving the value in the arr
 	for (uint32_t i = 0; i < ht->size; i++) {
-		struct slist *l = ht->table[i];
-		struct snode *node = l->front;
-		while (node != NULL) {
-			arr[idx] = ((struct kv_pair *)node->data)->value;
-			idx++;
-			node = node->next;
+		if (ht->slots[i].kv.key != NULL) {
+			arr[idx++] = ht->slots[i].kv.value;
+		}
+	}
+	for (uint32_t i = 0; i < ht->old_size; i++) {
+		if (ht->old_slots[i].kv.key != NULL) {
+			arr[idx++] = ht->old_slots[i].kv.value;
 		}
 	}
 
@@ -203,27 +348,20 @@ void **htable_values(struct htable *ht) {
 }
 
 struct htable *htable_dupe(struct htable *ht) {
-    // Allocate memory for new hash table
-    struct htable *hashmap = htable_create(ht->size);
-
-    // Duplicate each bucket in the table
-    for (uint32_t i = 0; i < ht->size; i++) {
-
-        struct slist *orig_bucket = ht->table[i];
-        struct snode *node = orig_bucket->front;
-
-		// Go through all nodes in the given bucket in original htable and copy them
-        while (node != NULL) {
-			// Get original kv pair
-            struct kv_pair *orig_kv = (struct kv_pair *)node->data;
-
-            htable_insert(hashmap, orig_kv->key, orig_kv->value);
+	// Allocate memory for new hash table, big enough for every element
+	struct htable *hashmap = htable_create(ht->num_elems);
+	if (!hashmap) {
+		return NULL;
+	}
 
-            node = node->next;
-        }
-    }
+	// Copy every pair of the original (both arrays during a rehash)
+	struct htable_iter iter = { ht, 0 };
+	struct kv_pair *kv;
+	while ((kv = htable_iter_next(&iter)) != NULL) {
+		htable_insert(hashmap, kv->key, kv->value);
+	}
 
-    return hashmap;
+	return hashmap;
 }
 
 
@@ -231,7 +369,6 @@ struct htable_iter* htable_create_iter(struct htable *ht) {
 	struct htable_iter *iter = (struct htable_iter *) malloc(sizeof(struct htable_iter));
 	iter->ht = ht;
 	iter->index = 0;
-	iter->current = NULL;
 
 	return iter;
 }
@@ -247,32 +384,63 @@ void htable_destroy_iter(struct htable_iter *iter) {
 
 struct kv_pair *htable_iter_next(struct htable_iter *iter) {
     if (!iter || !iter->ht) {
-        return NULL;  
+        return NULL;
     }
 
     struct htable *ht = iter->ht;
-    struct slist **table = ht->table;
-
-    // If the current node is valid, move to the next node
-    if (iter->current) {
-        iter->current = iter->current->next;
-		// If next node is NOT NULL, then return early
-        if (iter->current) {
-            return (struct kv_pair *)iter->current->data;
-        }
-    }
 
-    // Move to the next non-empty bucket (ONLY RUNS WHEN current is NULL)
-    while (iter->index < ht->size) {
-		// Index contains the index of the next bucket (not the same one in previous code block)
-        struct slist *bucket = table[iter->index];
-        if (bucket && bucket->front) {
-            iter->current = bucket->front;
-            iter->index++;  // Move index forward for next call/time this while loop runs
-            return (struct kv_pair *)iter->current->data; // valid node so return early
+    // Move to the next occupied slot; index counts through slots and then old_slots
+    while (iter->index < ht->size + ht->old_size) {
+        uint32_t i = iter->index++;
+        struct htable_slot *slot = i < ht->size ? &ht->slots[i] : &ht->old_slots[i - ht->size];
+        if (slot->kv.key != NULL) {
+            return &slot->kv;
         }
-        iter->index++;  // Move to the next bucket for next call/time this while loop runs
     }
 
     return NULL;  // No more elements
-}
\ No newline at end of file
+}
+
+static void stats_add(struct htable_stats *stats, struct htable_slot *slots, uint32_t size, uint64_t *total) {
+	for (uint32_t i = 0; i < size; i++) {
+		if (slots[i].kv.key == NULL) {
+			continue;
+		}
+		uint32_t d = slots[i].dist;
+		stats->probe_hist[d < HTABLE_STATS_HIST - 1 ? d : HTABLE_STATS_HIST - 1]++;
+		if (d > stats->max_probe) {
+			stats->max_probe = d;
+		}
+		*total += d;
+	}
+}
+
+void htable_stats(struct htable *ht, struct htable_stats *stats) {
+	memset(stats, 0, sizeof(*stats));
+	stats->size = ht->size;
+	stats->num_elems = ht->num_elems;
+	stats->old_size = ht->old_size;
+	stats->old_elems = ht->old_elems;
+	stats->load = (double)ht->num_elems / ht->size;	// where the rehash is heading
+
+	uint64_t total = 0;
+	stats_add(stats, ht->slots, ht->size, &total);
+	stats_add(stats, ht->old_slots, ht->old_size, &total);
+	stats->mean_probe = ht->num_elems > 0 ? (double)total / ht->num_elems : 0;
+}
+
+void htable_print_stats(FILE *out, const char *name, struct htable *ht) {
+	struct htable_stats stats;
+	htable_stats(ht, &stats);
+
+	fprintf(out, "%s: %u elements, %u slots (load %.2f), probe length mean %.2f max %u",
+		name, stats.num_elems, stats.size, stats.load, stats.mean_probe, stats.max_probe);
+	if (stats.old_size > 0) {
+		fprintf(out, ", rehashing (%u of %u left)", stats.old_elems, stats.old_size);
+	}
+	fprintf(out, "\n  probe histogram:");
+	for (int i = 0; i < HTABLE_STATS_HIST; i++) {
+		fprintf(out, " %s%d:%u", i == HTABLE_STATS_HIST - 1 ? ">=" : "", i, stats.probe_hist[i]);
+	}
+	fprintf(out, "\n");
+}
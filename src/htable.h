@@ -17,35 +17,74 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#include "snode.h"
-#include "slist.h"
+/**
+ * @brief a key-value pair is stored for every inserted element. the key is not copied, so it must
+ * outlive the table (it normally points into the value).
+ */
+struct kv_pair {
+	const char *key;
+	void *value;
+};
 
+/**
+ * @brief the table is open-addressed with Robin Hood probing: every element lives directly in the
+ * slot array, at most a few slots past its home slot, and an insert that has probed further than the
+ * element sitting in a slot takes that slot over and moves the other element on. this keeps probe
+ * lengths short and even, and a lookup can stop as soon as it has probed further than the element it
+ * is looking at. the full hash is kept in the slot so most mismatches are rejected without strcmp.
+ */
+struct htable_slot {
+	struct kv_pair kv;		// kv.key == NULL marks an empty slot
+	uint32_t hash;
+	uint32_t dist;			// distance from the home slot (hash & (size - 1))
+};
+
+/**
+ * @brief when the table passes its load limit it allocates a slot array twice the size, but does not
+ * move everything at once: each later insert or delete moves a few elements from the old array, so no
+ * single call pays for the whole rehash. until the old array is empty, lookups check both arrays.
+ * lookups never move anything, so concurrent readers of a table nobody writes are still safe.
+ */
 struct htable {
-	struct slist **table;
-	uint32_t size;
-	uint32_t num_elems;
+	struct htable_slot *slots;
+	uint32_t size;			// number of slots, a power of two
+	uint32_t num_elems;		// in both arrays
+
+	// Rehash in progress (old_slots == NULL otherwise)
+	struct htable_slot *old_slots;
+	uint32_t old_size;
+	uint32_t old_elems;		// elements not moved yet
+	uint32_t migrate_pos;	// next old slot to move
 };
 
 struct htable_iter {
 	struct htable *ht;
-	uint32_t index;
-	struct snode *current;
+	uint32_t index;			// slots first, then old_slots
 };
 
+// Probe lengths 0 .. HTABLE_STATS_HIST - 2 are counted exactly; the last bucket holds the rest
+#define HTABLE_STATS_HIST 16
+
 /**
- * @brief a key-value pair is created for all inserted elements and added to the corresponding singly linked list.
- * when searching for a key, the hash table will first find the corresponding singly linked list and then search for the key in that list.
- * the compare_key function is used to compare two keys.
+ * @brief load and probe-length distribution of a table (see htable_stats()).
+ * a probe length is how many slots past its home slot an element sits, i.e. how many extra slots a
+ * lookup of it reads: the open-addressing counterpart of its position in a bucket chain.
  */
-struct kv_pair {
-	const char *key;
-	void *value;
+struct htable_stats {
+	uint32_t size;
+	uint32_t num_elems;
+	double load;
+	uint32_t old_size;		// 0 unless a rehash is in progress
+	uint32_t old_elems;
+	uint32_t max_probe;
+	double mean_probe;
+	uint32_t probe_hist[HTABLE_STATS_HIST];
 };
 
 /**
- * @brief Create a hash table object.
+ * @brief Create a hash table object. The table grows by itself, so size is only a hint.
  * 
- * @param size The size of the hash table.
+ * @param size The expected number of elements.
  * @return struct htable* A pointer to the hash table.
  */
 struct htable *htable_create(uint32_t size);
@@ -68,6 +107,16 @@ void htable_destroy(struct htable *ht);
  */
 bool htable_insert(struct htable *ht, const char *key, void *value);
 
+/**
+ * @brief find key, adding it (with a NULL value) if it is not there yet, in a single probe.
+ * 
+ * @param ht 
+ * @param key stored as-is when inserted, like htable_insert()
+ * @param inserted set to true if the key was just added; the caller then fills in kv->value
+ * @return struct kv_pair* the pair for key (valid until the next insert or delete), or NULL if out of memory.
+ */
+struct kv_pair *htable_find_or_insert(struct htable *ht, const char *key, bool *inserted);
+
 /**
  * @brief update the value of an existing key in the hash table.
  * 
@@ -139,4 +188,20 @@ void htable_destroy_iter(struct htable_iter *iter);
  */
 struct kv_pair *htable_iter_next(struct htable_iter *iter);
 
+/**
+ * @brief move whatever an in-progress rehash has left, so lookups search one array again.
+ * meant for tables that are done being written and are about to be read a lot.
+ */
+void htable_finish_rehash(struct htable *ht);
+
+/**
+ * @brief fill in the size, load and probe-length distribution of the table.
+ */
+void htable_stats(struct htable *ht, struct htable_stats *stats);
+
+/**
+ * @brief print the statistics of a table on one line plus a histogram line.
+ */
+void htable_print_stats(FILE *out, const char *name, struct htable *ht);
+
 #endif /* _HTABLE_H_ */
\ No newline at end of file
@@ -0,0 +1,305 @@
+/**
+ * @file sbench.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Loopback load generator for sserver.
+ * @version 0.1
+ * @date 2025-03-21
+ *
+ * Opens a number of persistent connections, one thread each, and keeps a
+ * fixed number of identical requests in flight on every connection for a
+ * fixed time. Prints throughput and request latency, so the server's I/O
+ * backends (--backend epoll|uring) can be compared under the same load.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "spotify.h"
+
+// Latency samples kept per connection
+#define MAX_SAMPLES 1000000
+
+struct bench_conn {
+    pthread_t thread;
+    int fd;
+    struct request_msg req;
+    int pipeline;           // requests kept in flight
+    double duration;        // seconds
+
+    // Results
+    long requests;
+    long bytes;
+    long errors;
+    double *lat;            // per-request latency in microseconds
+    long nlat;
+};
+
+static const char *command_names[] = {
+    "TEST", "SHOW_TRACKS", "SHOW_ALBUMS", "SHOW_PLAYLISTS", "SEARCH_TRACKS",
+    "SEARCH_ALBUMS", "SEARCH_ARTISTS", "SEARCH_PLAYLISTS"
+};
+
+unsigned int compute_checksum(void *message, int size, unsigned int seed) {
+    if (message == NULL) {
+        return seed;
+    }
+
+    unsigned char *data = (unsigned char *)message;
+    for (int i = 0; i < size; i++) {
+        seed += data[i];
+    }
+    return seed & 0xffffffff;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int send_all(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void *buf, size_t len) {
+    char *p = (char *)buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read one response and throw its body away.
+ *
+ * @return long bytes read, or -1 if the connection failed
+ */
+static long recv_response(int fd, char *scratch, size_t scratch_size, int *is_error) {
+    struct response_header header;
+    if (recv_all(fd, &header, sizeof(header)) < 0) {
+        return -1;
+    }
+
+    size_t body;
+    if (header.status == ERROR) {
+        body = sizeof(((struct response_msg *)0)->error_message);
+        *is_error = 1;
+    } else {
+        body = header.num_tracks * sizeof(struct track) + header.num_albums * sizeof(struct album) +
+               header.num_playlists * sizeof(struct playlist);
+        *is_error = 0;
+    }
+
+    size_t left = body;
+    while (left > 0) {
+        size_t chunk = left < scratch_size ? left : scratch_size;
+        if (recv_all(fd, scratch, chunk) < 0) {
+            return -1;
+        }
+        left -= chunk;
+    }
+    return (long)(sizeof(header) + body);
+}
+
+static void *bench_main(void *arg) {
+    struct bench_conn *bc = (struct bench_conn *)arg;
+    size_t scratch_size = 1 << 20;
+    char *scratch = (char *)malloc(scratch_size);
+    double *sent_at = (double *)calloc(bc->pipeline, sizeof(double));
+    if (!scratch || !sent_at) {
+        free(scratch);
+        free(sent_at);
+        return NULL;
+    }
+
+    // Requests are answered in order, so a ring of send times is enough
+    double end = now() + bc->duration;
+    long head = 0, tail = 0;
+    for (; tail < bc->pipeline; tail++) {
+        sent_at[tail % bc->pipeline] = now();
+        if (send_all(bc->fd, &bc->req, sizeof(bc->req)) < 0) {
+            bc->errors++;
+            goto out;
+        }
+    }
+
+    while (head < tail) {
+        int is_error;
+        long n = recv_response(bc->fd, scratch, scratch_size, &is_error);
+        if (n < 0) {
+            bc->errors++;
+            break;
+        }
+        double t = now();
+        if (bc->nlat < MAX_SAMPLES) {
+            bc->lat[bc->nlat++] = (t - sent_at[head % bc->pipeline]) * 1e6;
+        }
+        head++;
+        bc->requests++;
+        bc->bytes += n;
+        bc->errors += is_error;
+
+        if (t < end) {
+            sent_at[tail % bc->pipeline] = t;
+            if (send_all(bc->fd, &bc->req, sizeof(bc->req)) < 0) {
+                bc->errors++;
+                break;
+            }
+            tail++;
+        }
+    }
+
+out:
+    free(scratch);
+    free(sent_at);
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <PORT> [-c CONNS] [-d SECONDS] [-p PIPELINE] <COMMAND> [ARGS]\n", prog);
+    fprintf(stderr, "  COMMAND is one of SHOW_TRACKS, SHOW_ALBUMS, SHOW_PLAYLISTS, SEARCH_TRACKS,\n");
+    fprintf(stderr, "  SEARCH_ALBUMS, SEARCH_ARTISTS, SEARCH_PLAYLISTS, or TEST (rejected by the server\n");
+    fprintf(stderr, "  without touching the data, so it measures the I/O path alone)\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int port = atoi(argv[1]);
+    int conns = 16;
+    int pipeline = 1;
+    double duration = 5;
+    int i = 2;
+    for (; i < argc && argv[i][0] == '-'; i += 2) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-c") == 0) {
+            conns = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            duration = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            pipeline = atoi(argv[i + 1]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (i >= argc || port <= 0 || conns <= 0 || pipeline <= 0 || duration <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Build the request once; every connection sends the same bytes
+    struct request_msg req;
+    memset(&req, 0, sizeof(req));
+    int found = 0;
+    for (size_t c = 0; c < sizeof(command_names) / sizeof(command_names[0]); c++) {
+        if (strcmp(argv[i], command_names[c]) == 0) {
+            req.command = (enum command_id)c;
+            found = 1;
+        }
+    }
+    if (!found) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (i + 1 < argc) {
+        strncpy(req.args, argv[i + 1], sizeof(req.args) - 1);
+    }
+    req.check = compute_checksum(&req, sizeof(req), 7331);
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    struct bench_conn *bcs = (struct bench_conn *)calloc(conns, sizeof(struct bench_conn));
+    for (int c = 0; c < conns; c++) {
+        bcs[c].fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (bcs[c].fd < 0 || connect(bcs[c].fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            perror("connect failed");
+            return 2;
+        }
+        bcs[c].req = req;
+        bcs[c].pipeline = pipeline;
+        bcs[c].duration = duration;
+        bcs[c].lat = (double *)malloc(MAX_SAMPLES * sizeof(double));
+    }
+
+    double start = now();
+    for (int c = 0; c < conns; c++) {
+        pthread_create(&bcs[c].thread, NULL, bench_main, &bcs[c]);
+    }
+    long requests = 0, bytes = 0, errors = 0, nlat = 0;
+    for (int c = 0; c < conns; c++) {
+        pthread_join(bcs[c].thread, NULL);
+        requests += bcs[c].requests;
+        bytes += bcs[c].bytes;
+        errors += bcs[c].errors;
+        nlat += bcs[c].nlat;
+    }
+    double elapsed = now() - start;
+
+    // Merge the latency samples for percentiles
+    double *lat = (double *)malloc((nlat > 0 ? nlat : 1) * sizeof(double));
+    long k = 0;
+    double sum = 0;
+    for (int c = 0; c < conns; c++) {
+        memcpy(lat + k, bcs[c].lat, bcs[c].nlat * sizeof(double));
+        k += bcs[c].nlat;
+        close(bcs[c].fd);
+        free(bcs[c].lat);
+    }
+    for (long j = 0; j < nlat; j++) {
+        sum += lat[j];
+    }
+    qsort(lat, nlat, sizeof(double), cmp_double);
+
+    printf("%s '%s': %d connections x %d in flight, %.1f s\n", argv[i], req.args, conns, pipeline, elapsed);
+    printf("  requests   %ld (%ld error responses)\n", requests, errors);
+    printf("  throughput %.0f req/s, %.1f MB/s\n", requests / elapsed, bytes / elapsed / 1e6);
+    if (nlat > 0) {
+        printf("  latency    mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               sum / nlat, lat[nlat / 2], lat[(long)(nlat * 0.99)], lat[nlat - 1]);
+    }
+
+    free(lat);
+    free(bcs);
+    return 0;
+}
@@ -113,23 +113,28 @@ int read_csv_to_lists (FILE *file, struct slist *plays, struct htable *tracks, s
                 
                 slist_add_back(plays, p);
 
-                if (htable_find(tracks, p->track_id) == NULL) {
-                    htable_insert(tracks, p->track_id, t);
+                // Keep the first record seen for every ID
+                bool inserted;
+                struct kv_pair *kv = htable_find_or_insert(tracks, p->track_id, &inserted);
+                if (inserted) {
+                    kv->value = t;
                 } else {
                     free(t);
                 }
-                
-                if (htable_find(albums, p->album_id) == NULL) {
-                    htable_insert(albums, p->album_id, a);
+
+                kv = htable_find_or_insert(albums, p->album_id, &inserted);
+                if (inserted) {
+                    kv->value = a;
                 } else {
                     free(a);
                 }
-                
-                if (htable_find(playlists, p->playlist_id) == NULL) {
-                    htable_insert(playlists, p->playlist_id, pl);
+
+                kv = htable_find_or_insert(playlists, p->playlist_id, &inserted);
+                if (inserted) {
+                    kv->value = pl;
                 } else {
                     free(pl);
-                }                
+                }
 // uncomment this block to print the data
 // #define DEBUG_PRINT
 #ifdef DEBUG_PRINT
@@ -456,11 +461,12 @@ struct htable* create_track_by_album(struct slist *plays) {
         struct play *data = (struct play*)p->data;
 
         // Retrieve existing list or create a new one
-        struct slist *track_list = (struct slist*)htable_find(track_by_album, data->album_id);
-        if (!track_list) {
-            track_list = slist_create();
-            htable_insert(track_by_album, data->album_id, track_list);
+        bool inserted;
+        struct kv_pair *kv = htable_find_or_insert(track_by_album, data->album_id, &inserted);
+        if (inserted) {
+            kv->value = slist_create();
         }
+        struct slist *track_list = (struct slist *)kv->value;
         // Check if track ID is already in the list before adding
         if (!slist_find_value(track_list, data->track_id, compare_str)) {
             slist_add_back(track_list, data->track_id);
@@ -484,11 +490,12 @@ struct htable* create_album_by_track(struct slist *plays) {
         struct play *data = (struct play*)p->data;
 
         // Retrieve existing list or create a new one
-        struct slist *album_list = (struct slist*)htable_find(album_by_track, data->track_id);
-        if (!album_list) {
-            album_list = slist_create();
-            htable_insert(album_by_track, data->track_id, album_list);
+        bool inserted;
+        struct kv_pair *kv = htable_find_or_insert(album_by_track, data->track_id, &inserted);
+        if (inserted) {
+            kv->value = slist_create();
         }
+        struct slist *album_list = (struct slist *)kv->value;
         // Check if album ID is already in the list before adding
         if (!slist_find_value(album_list, data->album_id, compare_str)) {
             slist_add_back(album_list, data->album_id);
@@ -517,11 +524,12 @@ struct htable* create_album_by_artist(struct slist *plays, struct htable *tracks
         }
 
         // Retrieve existing list or create a new one
-        struct slist *album_list = (struct slist*)htable_find(album_by_artist, t->artist);
-        if (!album_list) {
-            album_list = slist_create();
-            htable_insert(album_by_artist, t->artist, album_list);
+        bool inserted;
+        struct kv_pair *kv = htable_find_or_insert(album_by_artist, t->artist, &inserted);
+        if (inserted) {
+            kv->value = slist_create();
         }
+        struct slist *album_list = (struct slist *)kv->value;
         // Check if album ID is already in the list before adding
         if (!slist_find_value(album_list, data->album_id, compare_str)) {
             slist_add_back(album_list, data->album_id);
@@ -545,11 +553,12 @@ struct htable* create_track_by_playlist(struct slist *plays) {
         struct play *data = (struct play*)p->data;
 
         // Retrieve existing list or create a new one
-        struct slist *track_list = (struct slist*)htable_find(track_by_playlist, data->playlist_id);
-        if (!track_list) {
-            track_list = slist_create();
-            htable_insert(track_by_playlist, data->playlist_id, track_list);
+        bool inserted;
+        struct kv_pair *kv = htable_find_or_insert(track_by_playlist, data->playlist_id, &inserted);
+        if (inserted) {
+            kv->value = slist_create();
         }
+        struct slist *track_list = (struct slist *)kv->value;
         // Check if track ID is already in the list before adding
         if (!slist_find_value(track_list, data->track_id, compare_str)) {
             slist_add_back(track_list, data->track_id);
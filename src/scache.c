@@ -0,0 +1,137 @@
+/**
+ * @file scache.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Responses kept in their wire form, to answer repeated requests.
+ * @version 0.1
+ * @date 2025-05-02
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "scache.h"
+
+// Keys the index is sized for up front; it grows past that by itself
+#define SCACHE_INDEX_HINT 1024
+
+int scache_init(struct scache *c, size_t budget) {
+    memset(c, 0, sizeof(*c));
+    c->index = htable_create(SCACHE_INDEX_HINT);
+    if (!c->index) {
+        return -1;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    c->budget = budget;
+    return 0;
+}
+
+void scache_release(struct scache_entry *e) {
+    if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(e->data);
+        free(e);
+    }
+}
+
+static void unlink_entry(struct scache *c, struct scache_entry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else c->front = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else c->back = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void push_front(struct scache *c, struct scache_entry *e) {
+    e->prev = NULL;
+    e->next = c->front;
+    if (c->front) c->front->prev = e;
+    else c->back = e;
+    c->front = e;
+}
+
+/**
+ * @brief Stop listing e and drop the cache's reference (the lock is held).
+ */
+static void evict(struct scache *c, struct scache_entry *e) {
+    htable_del(c->index, e->key);
+    unlink_entry(c, e);
+    c->bytes -= e->len + strlen(e->key) + 1;
+    scache_release(e);
+}
+
+/**
+ * @brief Empty the cache if generation is newer than its entries (the lock is held).
+ */
+static void advance(struct scache *c, uint64_t generation) {
+    if (generation > c->generation) {
+        while (c->back) {
+            evict(c, c->back);
+        }
+        c->generation = generation;
+    }
+}
+
+void scache_destroy(struct scache *c) {
+    while (c->back) {
+        evict(c, c->back);
+    }
+    htable_destroy(c->index);
+    pthread_mutex_destroy(&c->lock);
+}
+
+struct scache_entry *scache_get(struct scache *c, const char *key, uint64_t generation) {
+    pthread_mutex_lock(&c->lock);
+    advance(c, generation);
+    struct scache_entry *e = generation == c->generation ? (struct scache_entry *)htable_find(c->index, key) : NULL;
+    if (e) {
+        unlink_entry(c, e);
+        push_front(c, e);
+        __atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+        c->hits++;
+    } else {
+        c->misses++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return e;
+}
+
+struct scache_entry *scache_put(struct scache *c, const char *key, uint64_t generation, unsigned char *data,
+                                size_t len) {
+    size_t key_size = strlen(key) + 1;
+    struct scache_entry *e = (struct scache_entry *)malloc(sizeof(struct scache_entry) + key_size);
+    if (!e) {
+        free(data);
+        return NULL;
+    }
+    memcpy(e + 1, key, key_size);
+    e->key = (const char *)(e + 1);
+    e->data = data;
+    e->len = len;
+    e->refs = 1;
+    e->prev = e->next = NULL;
+
+    pthread_mutex_lock(&c->lock);
+    advance(c, generation);
+    size_t size = len + key_size;
+    if (generation == c->generation && size <= c->budget / SCACHE_MAX_SHARE &&
+        htable_insert(c->index, e->key, e)) {
+        e->refs++;
+        push_front(c, e);
+        c->bytes += size;
+        while (c->bytes > c->budget) {
+            evict(c, c->back);
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    return e;
+}
+
+void scache_print_stats(FILE *out, struct scache *c) {
+    pthread_mutex_lock(&c->lock);
+    uint64_t lookups = c->hits + c->misses;
+    fprintf(out, "Response cache: %lu hits, %lu misses (%.1f%% hit), %u entries, %zu of %zu bytes\n",
+            (unsigned long)c->hits, (unsigned long)c->misses, lookups ? 100.0 * c->hits / lookups : 0.0,
+            htable_num_elems(c->index), c->bytes, c->budget);
+    pthread_mutex_unlock(&c->lock);
+}
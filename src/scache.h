@@ -0,0 +1,98 @@
+#ifndef SCACHE_H
+#define SCACHE_H
+
+/**
+ * @file scache.h
+ * @brief Responses kept in their wire form, to answer repeated requests.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-05-02
+ *
+ * Each entry holds the exact bytes of one response (header, check sum and
+ * all), under a string key naming the request it answers. Entries are
+ * evicted least recently used first once their bytes pass the budget.
+ *
+ * Every entry is tagged with the catalog generation it was built from, and
+ * the cache only ever lists entries of one generation: the first lookup or
+ * insert with a newer one empties it, so nothing built from a replaced
+ * catalog is ever sent again.
+ *
+ * Entries are reference counted. The cache holds one reference while it
+ * lists an entry and every response queued to send it holds another, so an
+ * entry evicted while it is still being written is freed once it is sent.
+ * Every call is safe from any thread.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "htable.h"
+
+// An entry may take at most this share of the budget, so one huge answer cannot flush the rest
+#define SCACHE_MAX_SHARE 4
+
+struct scache_entry {
+    const char *key;                // stored in the same allocation
+    unsigned char *data;
+    size_t len;
+    uint32_t refs;
+    struct scache_entry *prev;      // recency list, most recent first
+    struct scache_entry *next;
+};
+
+struct scache {
+    pthread_mutex_t lock;
+    struct htable *index;           // key -> entry
+    struct scache_entry *front;
+    struct scache_entry *back;
+    size_t bytes;                   // data and keys of the listed entries
+    size_t budget;
+    uint64_t generation;            // of every listed entry
+    uint64_t hits;
+    uint64_t misses;
+};
+
+/**
+ * @brief Start an empty cache that keeps up to budget bytes.
+ *
+ * @return int 0, or -1 if out of memory
+ */
+int scache_init(struct scache *c, size_t budget);
+
+/**
+ * @brief Drop every entry (entries still being sent are freed when they are).
+ */
+void scache_destroy(struct scache *c);
+
+/**
+ * @brief Look up the answer to key built from the given generation, and
+ * count a hit or a miss.
+ *
+ * @return struct scache_entry* the entry with a reference for the caller
+ * (see scache_release()), or NULL on a miss
+ */
+struct scache_entry *scache_get(struct scache *c, const char *key, uint64_t generation);
+
+/**
+ * @brief Wrap len bytes of data (malloc'd; the cache takes them over) in an
+ * entry, and list it under key unless it is too big, of an older generation
+ * or already listed.
+ *
+ * @return struct scache_entry* the entry with a reference for the caller,
+ * listed or not, or NULL if out of memory (data is then freed)
+ */
+struct scache_entry *scache_put(struct scache *c, const char *key, uint64_t generation, unsigned char *data,
+                                size_t len);
+
+/**
+ * @brief Drop a reference; the last one frees the entry.
+ */
+void scache_release(struct scache_entry *e);
+
+/**
+ * @brief Print the hit and miss counts and what the cache holds, on one line.
+ */
+void scache_print_stats(FILE *out, struct scache *c);
+
+#endif // SCACHE_H
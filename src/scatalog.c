@@ -0,0 +1,909 @@
+/**
+ * @file scatalog.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Immutable, ID-ordered views of the song data.
+ * @version 0.1
+ * @date 2025-03-28
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdbool.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "sbrowser.h"
+#include "scatalog.h"
+#include "sradix.h"
+
+// Patch IDs a relation may hold before an insert folds them into new base
+// arrays: CSR_PATCH_MIN, plus CSR_PATCH_PER_ROOT per square root of the base.
+// Each insert copies the patches and each fold copies everything, so a budget
+// that grows with the root keeps both costs to about the root per insert
+#define CSR_PATCH_MIN 4096
+#define CSR_PATCH_PER_ROOT 16
+
+static int playlist_sort_flat(const void *a, const void *b) {
+    const struct playlist *p1 = (const struct playlist *)a;
+    const struct playlist *p2 = (const struct playlist *)b;
+    return strcmp(p1->playlist_id, p2->playlist_id);
+}
+
+/**
+ * @brief Copy every value of a hash table into one contiguous array.
+ *
+ * @return void* the array (NULL for an empty table or on failure)
+ */
+static void *flatten(struct htable *ht, size_t elem_size, uint32_t *count) {
+    *count = htable_num_elems(ht);
+    if (*count == 0) {
+        return NULL;
+    }
+
+    char *arr = (char *)malloc((size_t)*count * elem_size);
+    void **values = htable_values(ht);
+    if (!arr || !values) {
+        free(arr);
+        free(values);
+        *count = 0;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < *count; i++) {
+        memcpy(arr + (size_t)i * elem_size, values[i], elem_size);
+    }
+    free(values);
+    return arr;
+}
+
+/**
+ * @brief Index one name field of a record array (name_off bytes into each record).
+ */
+static struct trigram_index *index_field(const void *records, size_t stride, size_t name_off, uint32_t n) {
+    const char **names = (const char **)malloc((n > 0 ? n : 1) * sizeof(char *));
+    if (!names) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        names[i] = (const char *)records + (size_t)i * stride + name_off;
+    }
+    struct trigram_index *idx = trigram_index_create(names, n);
+    free(names);
+    return idx;
+}
+
+/**
+ * @brief Map every ID string to its record's position in a sorted record array.
+ */
+static struct htable *intern_ids(void *records, size_t stride, uint32_t n) {
+    struct htable *ids = htable_create(n);
+    if (!ids) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        // Every record struct starts with its ID; the value is the record itself
+        char *record = (char *)records + (size_t)i * stride;
+        htable_insert(ids, record, record);
+    }
+    return ids;
+}
+
+/**
+ * @brief Dense ID of the record with the given ID string.
+ *
+ * @return uint32_t the dense ID, or CATALOG_NO_ID if no record has it
+ */
+static uint32_t dense_id(struct htable *ids, const void *records, size_t stride, const char *id) {
+    const char *record = (const char *)htable_find(ids, id);
+    return record ? (uint32_t)((record - (const char *)records) / stride) : CATALOG_NO_ID;
+}
+
+static int compare_artist(const void *key, const void *elem) {
+    return strcmp((const char *)key, *(const char *const *)elem);
+}
+
+const uint32_t *csr_row(const struct csr *rel, uint32_t row, uint32_t *len) {
+    uint32_t lo = 0, hi = rel->num_patched;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (rel->patch_rows[mid] < row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < rel->num_patched && rel->patch_rows[lo] == row) {
+        *len = rel->patch_offsets[lo + 1] - rel->patch_offsets[lo];
+        return rel->patch_ids + rel->patch_offsets[lo];
+    }
+    *len = rel->offsets[row + 1] - rel->offsets[row];
+    return rel->ids + rel->offsets[row];
+}
+
+/**
+ * @brief Write the row old (old_len members) with the members of pairs added
+ * to out. With sort_members the row stays ascending; otherwise new members
+ * follow the old ones in the order they came in. Repeats are dropped.
+ *
+ * @return uint32_t the members written
+ */
+static uint32_t merge_row(uint32_t *out, const uint32_t *old, uint32_t old_len, const uint64_t *pairs, size_t n,
+                          bool sort_members) {
+    uint32_t k = 0;
+    size_t p = 0;
+    if (!sort_members) {
+        memcpy(out, old, old_len * sizeof(uint32_t));
+        k = old_len;
+        // Unsorted rows are short (a track is on a few albums): scan for repeats
+        for (; p < n; p++) {
+            uint32_t member = (uint32_t)pairs[p];
+            uint32_t j = 0;
+            while (j < k && out[j] != member) j++;
+            if (j == k) out[k++] = member;
+        }
+        return k;
+    }
+
+    uint32_t i = 0;
+    while (i < old_len || p < n) {
+        uint32_t member = (p == n || (i < old_len && old[i] <= (uint32_t)pairs[p])) ? old[i++] : (uint32_t)pairs[p++];
+        if (k == 0 || out[k - 1] != member) {
+            out[k++] = member;
+        }
+    }
+    return k;
+}
+
+/**
+ * @brief Lay rel (num_rows rows) out afresh as out, with every patch in place.
+ */
+static int csr_fold(struct csr *out, const struct csr *rel, uint32_t num_rows) {
+    size_t total = rel->offsets[num_rows] + rel->patch_offsets[rel->num_patched];
+    out->offsets = (uint32_t *)malloc((num_rows + 1) * sizeof(uint32_t));
+    out->ids = (uint32_t *)malloc((total + 1) * sizeof(uint32_t));
+    if (!out->offsets || !out->ids) {
+        return -1;
+    }
+
+    uint32_t k = 0;
+    out->offsets[0] = 0;
+    for (uint32_t r = 0; r < num_rows; r++) {
+        uint32_t len;
+        const uint32_t *row = csr_row(rel, r, &len);
+        memcpy(out->ids + k, row, len * sizeof(uint32_t));
+        k += len;
+        out->offsets[r + 1] = k;
+    }
+    return 0;
+}
+
+/**
+ * @brief Build out as rel (num_rows rows) with the (row << 32 | member) pairs
+ * added (see merge_row()). Only the rows with new pairs are written, as
+ * patches next to the ones rel already has; out shares rel's base arrays
+ * (borrowed: the caller settles who owns them). Once the patches outgrow
+ * their budget, out gets base arrays of its own instead. pairs is clobbered.
+ */
+static int csr_insert(struct csr *out, const struct csr *rel, uint32_t num_rows, uint64_t *pairs, size_t n,
+                      bool sort_members) {
+    memset(out, 0, sizeof(struct csr));
+    if (radix_sort_u64(pairs, n, sort_members ? 0 : 4) < 0) {
+        return -1;
+    }
+
+    // Room for the old patches, plus every row the pairs touch with its new members
+    size_t old_ids = rel->num_patched > 0 ? rel->patch_offsets[rel->num_patched] : 0;
+    size_t room = old_ids + n;
+    uint32_t touched = 0;
+    for (size_t p = 0; p < n; p++) {
+        uint32_t row = (uint32_t)(pairs[p] >> 32);
+        if (p == 0 || row != (uint32_t)(pairs[p - 1] >> 32)) {
+            uint32_t len;
+            csr_row(rel, row, &len);
+            room += len;
+            touched++;
+        }
+    }
+    out->patch_rows = (uint32_t *)malloc((rel->num_patched + touched + 1) * sizeof(uint32_t));
+    out->patch_offsets = (uint32_t *)malloc((rel->num_patched + touched + 1) * sizeof(uint32_t));
+    out->patch_ids = (uint32_t *)malloc((room + 1) * sizeof(uint32_t));
+    if (!out->patch_rows || !out->patch_offsets || !out->patch_ids) {
+        return -1;
+    }
+
+    // Merge the old patched rows with the touched ones, both ascending
+    uint32_t m = 0, i = 0, k = 0;
+    size_t p = 0;
+    out->patch_offsets[0] = 0;
+    while (i < rel->num_patched || p < n) {
+        uint32_t row = p < n ? (uint32_t)(pairs[p] >> 32) : UINT32_MAX;
+        if (i < rel->num_patched && rel->patch_rows[i] < row) {
+            row = rel->patch_rows[i];
+            uint32_t len = rel->patch_offsets[i + 1] - rel->patch_offsets[i];
+            memcpy(out->patch_ids + k, rel->patch_ids + rel->patch_offsets[i], len * sizeof(uint32_t));
+            k += len;
+            i++;
+        } else {
+            if (i < rel->num_patched && rel->patch_rows[i] == row) {
+                i++;
+            }
+            size_t end = p;
+            while (end < n && (uint32_t)(pairs[end] >> 32) == row) {
+                end++;
+            }
+            uint32_t len;
+            const uint32_t *old = csr_row(rel, row, &len);
+            k += merge_row(out->patch_ids + k, old, len, pairs + p, end - p, sort_members);
+            p = end;
+        }
+        out->patch_rows[m++] = row;
+        out->patch_offsets[m] = k;
+    }
+    out->num_patched = m;
+    out->offsets = rel->offsets;
+    out->ids = rel->ids;
+    out->borrowed = true;
+
+    size_t base = rel->offsets[num_rows], root = 1;
+    while (root * root < base) {
+        root *= 2;
+    }
+    if (k <= CSR_PATCH_MIN + CSR_PATCH_PER_ROOT * root) {
+        return 0;
+    }
+
+    // Over budget: lay the whole relation out again, with no patches left
+    struct csr folded = {0};
+    if (csr_fold(&folded, out, num_rows) < 0) {
+        free(folded.offsets);
+        free(folded.ids);
+        return -1;
+    }
+    free(out->patch_rows);
+    free(out->patch_offsets);
+    free(out->patch_ids);
+    *out = folded;
+    return 0;
+}
+
+/**
+ * @brief True when the ascending row of rel holds member.
+ */
+static bool csr_has(const struct csr *rel, uint32_t row, uint32_t member) {
+    uint32_t len;
+    const uint32_t *ids = csr_row(rel, row, &len);
+    uint32_t lo = 0, hi = len;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ids[mid] < member) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < len && ids[lo] == member;
+}
+
+/**
+ * @brief Once csr_insert() has built next from rel, give next whatever base
+ * arrays it still shares with rel, along with the duty to free them.
+ */
+static void csr_hand_over(struct csr *next, struct csr *rel) {
+    if (next->offsets == rel->offsets) {
+        next->borrowed = rel->borrowed;
+        rel->borrowed = true;
+    }
+}
+
+static void csr_destroy(struct csr *rel) {
+    if (!rel->borrowed) {
+        free(rel->offsets);
+        free(rel->ids);
+    }
+    free(rel->patch_rows);
+    free(rel->patch_offsets);
+    free(rel->patch_ids);
+}
+
+static uint64_t pack_pair(uint32_t row, uint32_t member) {
+    return ((uint64_t)row << 32) | member;
+}
+
+/**
+ * @brief A list of numbered jobs that threads take one at a time.
+ */
+struct job_queue {
+    int (*run)(void *ctx, uint32_t job);
+    void *ctx;
+    uint32_t num_jobs;
+    uint32_t next;
+    int failed;
+};
+
+static void *job_worker(void *arg) {
+    struct job_queue *q = (struct job_queue *)arg;
+    uint32_t job;
+    while ((job = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED)) < q->num_jobs) {
+        if (q->run(q->ctx, job) < 0) {
+            __atomic_store_n(&q->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run jobs 0..num_jobs-1 on up to num_threads threads (the caller's
+ * included). Each thread keeps taking the next job number until none remain.
+ *
+ * @return int 0, or -1 if any job failed
+ */
+static int run_jobs(int (*run)(void *, uint32_t), void *ctx, uint32_t num_jobs, uint32_t num_threads) {
+    struct job_queue q = { run, ctx, num_jobs, 0, 0 };
+    pthread_t threads[CATALOG_MAX_THREADS];
+    uint32_t started = 0;
+
+    if (num_threads > num_jobs) num_threads = num_jobs;
+    if (num_threads > CATALOG_MAX_THREADS) num_threads = CATALOG_MAX_THREADS;
+    // Whatever threads fail to start, the caller's thread still drains the queue
+    while (started + 1 < num_threads && pthread_create(&threads[started], NULL, job_worker, &q) == 0) {
+        started++;
+    }
+    job_worker(&q);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return q.failed ? -1 : 0;
+}
+
+// Rows of a relation are dealt out to its partitions in blocks of this many,
+// so two partitions never count into the same stretch of offsets
+#define PART_BLOCK_ROWS 1024
+
+// The relations, as build_ctx numbers them
+enum { REL_ALBUM_TRACKS, REL_TRACK_ALBUMS, REL_ARTIST_ALBUMS, REL_PLAYLIST_TRACKS, NUM_RELATIONS };
+
+/**
+ * @brief State shared by the build jobs. Every job writes only its own
+ * outputs and reads what earlier phases finished.
+ */
+struct build_ctx {
+    struct catalog *cat;
+    struct play **plays;            // the play list as an array
+    size_t num_plays;
+    uint32_t num_chunks;            // slices of plays translated in parallel
+    uint32_t num_parts;             // row partitions of each relation
+
+    struct htable *track_ids;
+    struct htable *album_ids;
+    struct htable *playlist_ids;
+
+    uint32_t *play_track;           // [num_plays] dense IDs of each play
+    uint32_t *play_album;
+    uint32_t *play_playlist;
+
+    // Pairs of each relation, grouped by partition, then by chunk within it:
+    // partition q of relation r starts at part_start[r][q] and chunk c writes
+    // its pairs for it from chunk_next[r][c][q] on (both flattened)
+    uint64_t *pairs[NUM_RELATIONS];
+    size_t *part_start;             // [NUM_RELATIONS][num_parts + 1]
+    size_t *chunk_next;             // [NUM_RELATIONS][num_chunks][num_parts]
+    uint32_t *members[NUM_RELATIONS];   // each partition's kept members, row by row, from its part_start
+};
+
+// Phase 1: lookup structures that only depend on the sorted arrays
+enum { JOB_TRACK_IDS, JOB_ALBUM_IDS, JOB_PLAYLIST_IDS, JOB_TRACK_ARTIST, NUM_INTERN_JOBS };
+
+// Phase 4: every name index, then every partition of every relation
+enum { JOB_TRACK_NAMES, JOB_ALBUM_NAMES, JOB_PLAYLIST_NAMES, JOB_ARTIST_NAMES, NUM_NAME_JOBS };
+
+static int intern_job(void *arg, uint32_t job) {
+    struct build_ctx *b = (struct build_ctx *)arg;
+    struct catalog *cat = b->cat;
+
+    switch (job) {
+    case JOB_TRACK_IDS:
+        b->track_ids = intern_ids(cat->tracks, sizeof(struct track), cat->num_tracks);
+        return b->track_ids ? 0 : -1;
+    case JOB_ALBUM_IDS:
+        b->album_ids = intern_ids(cat->albums, sizeof(struct album), cat->num_albums);
+        return b->album_ids ? 0 : -1;
+    case JOB_PLAYLIST_IDS:
+        b->playlist_ids = intern_ids(cat->playlists, sizeof(struct playlist), cat->num_playlists);
+        return b->playlist_ids ? 0 : -1;
+    default:
+        for (uint32_t t = 0; t < cat->num_tracks; t++) {
+            const char **artist = (const char **)bsearch(cat->tracks[t].artist, cat->artists, cat->num_artists,
+                                                         sizeof(char *), compare_artist);
+            cat->track_artist[t] = (uint32_t)(artist - cat->artists);
+        }
+        return 0;
+    }
+}
+
+/**
+ * @brief The relation r, its number of rows, and whether its rows are
+ * ascending. A track's albums keep CSV order, which is how SEARCH_TRACKS
+ * lists them; the other rows are sorted once here so that joins never sort
+ * per query.
+ */
+static struct csr *relation(struct catalog *cat, uint32_t r, uint32_t *num_rows, bool *sort_members) {
+    *sort_members = r != REL_TRACK_ALBUMS;
+    switch (r) {
+    case REL_ALBUM_TRACKS:
+        *num_rows = cat->num_albums;
+        return &cat->album_tracks;
+    case REL_TRACK_ALBUMS:
+        *num_rows = cat->num_tracks;
+        return &cat->track_albums;
+    case REL_ARTIST_ALBUMS:
+        *num_rows = cat->num_artists;
+        return &cat->artist_albums;
+    default:
+        *num_rows = cat->num_playlists;
+        return &cat->playlist_tracks;
+    }
+}
+
+/**
+ * @brief The (row, member) pair play i adds to relation r.
+ */
+static uint64_t relation_pair(const struct build_ctx *b, uint32_t r, size_t i) {
+    switch (r) {
+    case REL_ALBUM_TRACKS:
+        return pack_pair(b->play_album[i], b->play_track[i]);
+    case REL_TRACK_ALBUMS:
+        return pack_pair(b->play_track[i], b->play_album[i]);
+    case REL_ARTIST_ALBUMS:
+        return pack_pair(b->cat->track_artist[b->play_track[i]], b->play_album[i]);
+    default:
+        return pack_pair(b->play_playlist[i], b->play_track[i]);
+    }
+}
+
+static uint32_t row_part(const struct build_ctx *b, uint32_t row) {
+    return row / PART_BLOCK_ROWS % b->num_parts;
+}
+
+/**
+ * @brief Phase 2: translate one slice of the plays into dense IDs, and count
+ * the pairs it gives each partition of each relation. The ID tables are no
+ * longer written, so any number of threads may look them up.
+ */
+static int translate_job(void *arg, uint32_t chunk) {
+    struct build_ctx *b = (struct build_ctx *)arg;
+    struct catalog *cat = b->cat;
+    size_t begin = b->num_plays * chunk / b->num_chunks;
+    size_t end = b->num_plays * (chunk + 1) / b->num_chunks;
+
+    for (size_t i = begin; i < end; i++) {
+        struct play *p = b->plays[i];
+        b->play_track[i] = dense_id(b->track_ids, cat->tracks, sizeof(struct track), p->track_id);
+        b->play_album[i] = dense_id(b->album_ids, cat->albums, sizeof(struct album), p->album_id);
+        b->play_playlist[i] = dense_id(b->playlist_ids, cat->playlists, sizeof(struct playlist), p->playlist_id);
+        if (b->play_track[i] == CATALOG_NO_ID || b->play_album[i] == CATALOG_NO_ID ||
+            b->play_playlist[i] == CATALOG_NO_ID) {
+            // The loader adds a record for every play, so the input is inconsistent
+            fprintf(stderr, "Error: a play links %s, %s and %s, which are not all loaded\n", p->track_id,
+                    p->album_id, p->playlist_id);
+            return -1;
+        }
+        for (uint32_t r = 0; r < NUM_RELATIONS; r++) {
+            uint32_t row = (uint32_t)(relation_pair(b, r, i) >> 32);
+            b->chunk_next[((size_t)r * b->num_chunks + chunk) * b->num_parts + row_part(b, row)]++;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Phase 3: write one slice's pairs where phase 2 made room for them,
+ * in one pass over the slice for all four relations.
+ */
+static int scatter_job(void *arg, uint32_t chunk) {
+    struct build_ctx *b = (struct build_ctx *)arg;
+    size_t begin = b->num_plays * chunk / b->num_chunks;
+    size_t end = b->num_plays * (chunk + 1) / b->num_chunks;
+
+    for (size_t i = begin; i < end; i++) {
+        for (uint32_t r = 0; r < NUM_RELATIONS; r++) {
+            uint64_t pair = relation_pair(b, r, i);
+            size_t *next = &b->chunk_next[((size_t)r * b->num_chunks + chunk) * b->num_parts +
+                                          row_part(b, (uint32_t)(pair >> 32))];
+            b->pairs[r][(*next)++] = pair;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Phase 4: sort one partition of a relation and drop its repeated
+ * pairs. Its rows' member counts go into offsets (no other partition counts
+ * those rows) and its members into b->members, for phase 5 to place.
+ */
+static int partition_job(struct build_ctx *b, uint32_t r, uint32_t q) {
+    uint32_t num_rows;
+    bool sort_members;
+    struct csr *rel = relation(b->cat, r, &num_rows, &sort_members);
+    size_t begin = b->part_start[r * (b->num_parts + 1) + q];
+    size_t n = b->part_start[r * (b->num_parts + 1) + q + 1] - begin;
+    uint64_t *pairs = b->pairs[r] + begin;
+    uint32_t *out = b->members[r] + begin;
+    if (radix_sort_u64(pairs, n, sort_members ? 0 : 4) < 0) {
+        return -1;
+    }
+
+    // Rows are now contiguous. Sorted rows show a repeat right next to the
+    // original; unsorted ones are short (a track is on a few albums), so scan
+    size_t k = 0, row_begin = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t row = (uint32_t)(pairs[i] >> 32);
+        uint32_t member = (uint32_t)pairs[i];
+        if (i == 0 || row != (uint32_t)(pairs[i - 1] >> 32)) {
+            row_begin = k;
+        } else if (sort_members) {
+            if (pairs[i] == pairs[i - 1]) {
+                continue;
+            }
+        } else {
+            size_t j = row_begin;
+            while (j < k && out[j] != member) j++;
+            if (j < k) {
+                continue;
+            }
+        }
+        out[k++] = member;
+        rel->offsets[row + 1]++;
+    }
+    return 0;
+}
+
+static int index_job(void *arg, uint32_t job) {
+    struct build_ctx *b = (struct build_ctx *)arg;
+    struct catalog *cat = b->cat;
+
+    switch (job) {
+    case JOB_TRACK_NAMES:
+        cat->track_names = index_field(cat->tracks, sizeof(struct track), offsetof(struct track, name),
+                                       cat->num_tracks);
+        return cat->track_names ? 0 : -1;
+    case JOB_ALBUM_NAMES:
+        cat->album_names = index_field(cat->albums, sizeof(struct album), offsetof(struct album, name),
+                                       cat->num_albums);
+        return cat->album_names ? 0 : -1;
+    case JOB_PLAYLIST_NAMES:
+        cat->playlist_names = index_field(cat->playlists, sizeof(struct playlist), offsetof(struct playlist, name),
+                                          cat->num_playlists);
+        return cat->playlist_names ? 0 : -1;
+    case JOB_ARTIST_NAMES:
+        cat->artist_names = trigram_index_create(cat->artists, cat->num_artists);
+        return cat->artist_names ? 0 : -1;
+    default:
+        job -= NUM_NAME_JOBS;
+        return partition_job(b, job / b->num_parts, job % b->num_parts);
+    }
+}
+
+/**
+ * @brief Phase 5: copy one partition's members to their rows, now that the
+ * offsets of every row are known.
+ */
+static int place_job(void *arg, uint32_t job) {
+    struct build_ctx *b = (struct build_ctx *)arg;
+    uint32_t r = job / b->num_parts, q = job % b->num_parts;
+    uint32_t num_rows;
+    bool sort_members;
+    struct csr *rel = relation(b->cat, r, &num_rows, &sort_members);
+    const uint32_t *members = b->members[r] + b->part_start[r * (b->num_parts + 1) + q];
+
+    size_t stride = (size_t)b->num_parts * PART_BLOCK_ROWS;
+    for (size_t block = (size_t)q * PART_BLOCK_ROWS; block < num_rows; block += stride) {
+        uint32_t end = block + PART_BLOCK_ROWS < num_rows ? (uint32_t)block + PART_BLOCK_ROWS : num_rows;
+        uint32_t len = rel->offsets[end] - rel->offsets[block];
+        memcpy(rel->ids + rel->offsets[block], members, len * sizeof(uint32_t));
+        members += len;
+    }
+    return 0;
+}
+
+/**
+ * @brief Build every relation and name index. One walk over the play list
+ * collects it into an array; after that each phase splits its work into
+ * independent jobs that run in parallel. A relation is built in partitions
+ * of its rows, so its sorting is spread over every thread too.
+ */
+static int catalog_link(struct catalog *cat, struct slist *plays, uint32_t num_threads) {
+    struct build_ctx b = {0};
+    b.cat = cat;
+    b.num_plays = slist_num_elems(plays);
+    b.num_chunks = num_threads == 0 ? 1 : num_threads < CATALOG_MAX_THREADS ? num_threads : CATALOG_MAX_THREADS;
+    b.num_parts = b.num_chunks;
+    b.plays = (struct play **)malloc((b.num_plays + 1) * sizeof(struct play *));
+    b.play_track = (uint32_t *)malloc((b.num_plays + 1) * sizeof(uint32_t));
+    b.play_album = (uint32_t *)malloc((b.num_plays + 1) * sizeof(uint32_t));
+    b.play_playlist = (uint32_t *)malloc((b.num_plays + 1) * sizeof(uint32_t));
+    b.part_start = (size_t *)malloc(NUM_RELATIONS * (b.num_parts + 1) * sizeof(size_t));
+    b.chunk_next = (size_t *)calloc(NUM_RELATIONS * b.num_chunks * b.num_parts, sizeof(size_t));
+    cat->track_artist = (uint32_t *)malloc((cat->num_tracks + 1) * sizeof(uint32_t));
+
+    int ret = -1;
+    bool ok = b.plays && b.play_track && b.play_album && b.play_playlist && b.part_start && b.chunk_next &&
+              cat->track_artist;
+    for (uint32_t r = 0; r < NUM_RELATIONS && ok; r++) {
+        uint32_t num_rows;
+        bool sort_members;
+        struct csr *rel = relation(cat, r, &num_rows, &sort_members);
+        rel->offsets = (uint32_t *)calloc(num_rows + 1, sizeof(uint32_t));
+        b.pairs[r] = (uint64_t *)malloc((b.num_plays + 1) * sizeof(uint64_t));
+        b.members[r] = (uint32_t *)malloc((b.num_plays + 1) * sizeof(uint32_t));
+        ok = rel->offsets && b.pairs[r] && b.members[r];
+    }
+    if (!ok) {
+        goto out;
+    }
+
+    size_t i = 0;
+    for (struct snode *node = plays->front; node != NULL; node = node->next) {
+        b.plays[i++] = (struct play *)node->data;
+    }
+
+    if (run_jobs(intern_job, &b, NUM_INTERN_JOBS, num_threads) < 0 ||
+        run_jobs(translate_job, &b, b.num_chunks, num_threads) < 0) {
+        goto out;
+    }
+
+    // Turn each chunk's counts into where its pairs go: partitions one after
+    // another, and within one the chunks in order
+    for (uint32_t r = 0; r < NUM_RELATIONS; r++) {
+        size_t pos = 0;
+        for (uint32_t q = 0; q < b.num_parts; q++) {
+            b.part_start[r * (b.num_parts + 1) + q] = pos;
+            for (uint32_t c = 0; c < b.num_chunks; c++) {
+                size_t *next = &b.chunk_next[((size_t)r * b.num_chunks + c) * b.num_parts + q];
+                size_t count = *next;
+                *next = pos;
+                pos += count;
+            }
+        }
+        b.part_start[r * (b.num_parts + 1) + b.num_parts] = pos;
+    }
+
+    if (run_jobs(scatter_job, &b, b.num_chunks, num_threads) < 0 ||
+        run_jobs(index_job, &b, NUM_NAME_JOBS + NUM_RELATIONS * b.num_parts, num_threads) < 0) {
+        goto out;
+    }
+
+    // Every row's count is in; lay the rows out one after another
+    for (uint32_t r = 0; r < NUM_RELATIONS; r++) {
+        uint32_t num_rows;
+        bool sort_members;
+        struct csr *rel = relation(cat, r, &num_rows, &sort_members);
+        for (uint32_t row = 0; row < num_rows; row++) {
+            rel->offsets[row + 1] += rel->offsets[row];
+        }
+        rel->ids = (uint32_t *)malloc((rel->offsets[num_rows] + 1) * sizeof(uint32_t));
+        if (!rel->ids) {
+            goto out;
+        }
+    }
+    if (run_jobs(place_job, &b, NUM_RELATIONS * b.num_parts, num_threads) < 0) {
+        goto out;
+    }
+    ret = 0;
+
+out:
+    free(b.plays);
+    free(b.play_track);
+    free(b.play_album);
+    free(b.play_playlist);
+    free(b.part_start);
+    free(b.chunk_next);
+    for (uint32_t r = 0; r < NUM_RELATIONS; r++) {
+        free(b.pairs[r]);
+        free(b.members[r]);
+    }
+    if (b.track_ids) htable_destroy(b.track_ids);
+    if (b.album_ids) htable_destroy(b.album_ids);
+    if (b.playlist_ids) htable_destroy(b.playlist_ids);
+    return ret;
+}
+
+struct catalog *catalog_create(struct slist *plays, struct htable *tracks, struct htable *albums,
+                               struct htable *playlists, uint32_t num_threads) {
+    struct catalog *cat = (struct catalog *)calloc(1, sizeof(struct catalog));
+    if (!cat) {
+        return NULL;
+    }
+
+    cat->tracks = (struct track *)flatten(tracks, sizeof(struct track), &cat->num_tracks);
+    cat->albums = (struct album *)flatten(albums, sizeof(struct album), &cat->num_albums);
+    cat->playlists = (struct playlist *)flatten(playlists, sizeof(struct playlist), &cat->num_playlists);
+    if ((!cat->tracks && htable_num_elems(tracks) > 0) || (!cat->albums && htable_num_elems(albums) > 0) ||
+        (!cat->playlists && htable_num_elems(playlists) > 0)) {
+        catalog_destroy(cat);
+        return NULL;
+    }
+
+    qsort(cat->tracks, cat->num_tracks, sizeof(struct track), track_sort_flat);
+    qsort(cat->albums, cat->num_albums, sizeof(struct album), album_sort_flat);
+    qsort(cat->playlists, cat->num_playlists, sizeof(struct playlist), playlist_sort_flat);
+
+    // Distinct artists: sort every track's artist, then drop the repeats
+    if (cat->num_tracks > 0) {
+        cat->artists = (const char **)malloc(cat->num_tracks * sizeof(char *));
+        if (!cat->artists) {
+            catalog_destroy(cat);
+            return NULL;
+        }
+        for (uint32_t i = 0; i < cat->num_tracks; i++) {
+            cat->artists[i] = cat->tracks[i].artist;
+        }
+        qsort(cat->artists, cat->num_tracks, sizeof(char *), compare_str_ptr);
+
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < cat->num_tracks; i++) {
+            if (n == 0 || strcmp(cat->artists[n - 1], cat->artists[i]) != 0) {
+                cat->artists[n++] = cat->artists[i];
+            }
+        }
+        cat->num_artists = n;
+    }
+
+    if (catalog_link(cat, plays, num_threads) < 0) {
+        catalog_destroy(cat);
+        return NULL;
+    }
+
+    return cat;
+}
+
+void catalog_destroy(struct catalog *cat) {
+    if (!cat) return;
+
+    // A snapshot's arrays are all in the mapping; only the index headers and
+    // the artist pointers were allocated
+    if (cat->records_moved) {
+        // A newer generation frees them
+    } else if (cat->map) {
+        munmap(cat->map, cat->map_size);
+        free(cat->artists);
+        free(cat->track_names);
+        free(cat->album_names);
+        free(cat->playlist_names);
+        free(cat->artist_names);
+    } else {
+        free(cat->tracks);
+        free(cat->albums);
+        free(cat->playlists);
+        free(cat->artists);
+        free(cat->track_artist);
+        trigram_index_destroy(cat->track_names);
+        trigram_index_destroy(cat->album_names);
+        trigram_index_destroy(cat->playlist_names);
+        trigram_index_destroy(cat->artist_names);
+    }
+
+    csr_destroy(&cat->album_tracks);
+    csr_destroy(&cat->track_albums);
+    csr_destroy(&cat->artist_albums);
+    csr_destroy(&cat->playlist_tracks);
+    for (unsigned i = 0; i < CATALOG_MAX_ORDERS; i++) {
+        free(cat->orders[i]);
+    }
+    free(cat);
+}
+
+const uint32_t *catalog_order(struct catalog *cat, unsigned slot) {
+    return __atomic_load_n(&cat->orders[slot], __ATOMIC_ACQUIRE);
+}
+
+const uint32_t *catalog_keep_order(struct catalog *cat, unsigned slot, uint32_t *order) {
+    uint32_t *kept = NULL;
+    if (__atomic_compare_exchange_n(&cat->orders[slot], &kept, order, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return order;
+    }
+    free(order);
+    return kept;
+}
+
+static int compare_record_id(const void *key, const void *elem) {
+    // Every record struct starts with its ID
+    return strcmp((const char *)key, (const char *)elem);
+}
+
+static uint32_t find_record(const void *records, uint32_t n, size_t stride, const char *id) {
+    const char *record = (const char *)bsearch(id, records, n, stride, compare_record_id);
+    return record ? (uint32_t)((record - (const char *)records) / stride) : CATALOG_NO_ID;
+}
+
+uint32_t catalog_track_id(const struct catalog *cat, const char *track_id) {
+    return find_record(cat->tracks, cat->num_tracks, sizeof(struct track), track_id);
+}
+
+uint32_t catalog_album_id(const struct catalog *cat, const char *album_id) {
+    return find_record(cat->albums, cat->num_albums, sizeof(struct album), album_id);
+}
+
+uint32_t catalog_playlist_id(const struct catalog *cat, const char *playlist_id) {
+    return find_record(cat->playlists, cat->num_playlists, sizeof(struct playlist), playlist_id);
+}
+
+struct catalog *catalog_insert_plays(struct catalog *cat, const struct play *plays, size_t n, size_t *num_new) {
+    *num_new = 0;
+
+    // Dense IDs of the plays that add something, three per play. A play the
+    // album and the playlist both already list is in every relation already
+    uint32_t *ids = (uint32_t *)malloc((3 * n + 1) * sizeof(uint32_t));
+    if (!ids) {
+        return NULL;
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t t = catalog_track_id(cat, plays[i].track_id);
+        uint32_t a = catalog_album_id(cat, plays[i].album_id);
+        uint32_t p = catalog_playlist_id(cat, plays[i].playlist_id);
+        if (t == CATALOG_NO_ID || a == CATALOG_NO_ID || p == CATALOG_NO_ID ||
+            (csr_has(&cat->album_tracks, a, t) && csr_has(&cat->playlist_tracks, p, t))) {
+            continue;
+        }
+        ids[3 * k] = t;
+        ids[3 * k + 1] = a;
+        ids[3 * k + 2] = p;
+        k++;
+    }
+    *num_new = k;
+
+    struct catalog *next = k > 0 ? (struct catalog *)malloc(sizeof(struct catalog)) : NULL;
+    uint64_t *pairs = k > 0 ? (uint64_t *)malloc(k * sizeof(uint64_t)) : NULL;
+    if (!next || !pairs) {
+        free(ids);
+        free(next);
+        free(pairs);
+        return NULL;
+    }
+
+    // Everything but the relations' patches is shared with cat as it is
+    *next = *cat;
+    next->records_moved = false;
+    memset(next->orders, 0, sizeof(next->orders));
+    memset(&next->album_tracks, 0, sizeof(struct csr));
+    memset(&next->track_albums, 0, sizeof(struct csr));
+    memset(&next->artist_albums, 0, sizeof(struct csr));
+    memset(&next->playlist_tracks, 0, sizeof(struct csr));
+
+    // The same pairs relation_job() makes, for the new plays alone
+    for (size_t i = 0; i < k; i++) pairs[i] = pack_pair(ids[3 * i + 1], ids[3 * i]);
+    int ret = csr_insert(&next->album_tracks, &cat->album_tracks, cat->num_albums, pairs, k, true);
+    if (ret == 0) {
+        for (size_t i = 0; i < k; i++) pairs[i] = pack_pair(ids[3 * i], ids[3 * i + 1]);
+        ret = csr_insert(&next->track_albums, &cat->track_albums, cat->num_tracks, pairs, k, false);
+    }
+    if (ret == 0) {
+        for (size_t i = 0; i < k; i++) pairs[i] = pack_pair(cat->track_artist[ids[3 * i]], ids[3 * i + 1]);
+        ret = csr_insert(&next->artist_albums, &cat->artist_albums, cat->num_artists, pairs, k, true);
+    }
+    if (ret == 0) {
+        for (size_t i = 0; i < k; i++) pairs[i] = pack_pair(ids[3 * i + 2], ids[3 * i]);
+        ret = csr_insert(&next->playlist_tracks, &cat->playlist_tracks, cat->num_playlists, pairs, k, true);
+    }
+    free(pairs);
+    free(ids);
+
+    if (ret < 0) {
+        csr_destroy(&next->album_tracks);
+        csr_destroy(&next->track_albums);
+        csr_destroy(&next->artist_albums);
+        csr_destroy(&next->playlist_tracks);
+        free(next);
+        return NULL;
+    }
+    cat->records_moved = true;
+    csr_hand_over(&next->album_tracks, &cat->album_tracks);
+    csr_hand_over(&next->track_albums, &cat->track_albums);
+    csr_hand_over(&next->artist_albums, &cat->artist_albums);
+    csr_hand_over(&next->playlist_tracks, &cat->playlist_tracks);
+    return next;
+}
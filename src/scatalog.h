@@ -0,0 +1,169 @@
+#ifndef SCATALOG_H
+#define SCATALOG_H
+
+/**
+ * @file scatalog.h
+ * @brief Immutable, ID-ordered views of the song data for sserver.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-03-28
+ *
+ * The hash tables filled by read_csv_to_lists() answer lookups by ID, but
+ * have no order. The catalog copies their contents once, at startup, into
+ * contiguous arrays sorted the way responses list them, so SHOW is a slice.
+ *
+ * A record's position in its array is its dense ID: tracks, albums,
+ * playlists and artists are numbered 0..n-1 in Spotify-ID (or name) order,
+ * so comparing dense IDs orders records exactly like comparing the strings.
+ * Relations between records are stored in compressed sparse row form, and
+ * each searchable name gets a trigram index whose item numbers are dense IDs
+ * too.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "htable.h"
+#include "slist.h"
+#include "spotify.h"
+#include "strigram.h"
+
+// Most threads catalog_create() builds with
+#define CATALOG_MAX_THREADS 64
+
+// Dense ID returned by the catalog_*_id() lookups for an unknown Spotify ID
+#define CATALOG_NO_ID UINT32_MAX
+
+// Listing orders a catalog can keep (see catalog_order())
+#define CATALOG_MAX_ORDERS 16
+
+/**
+ * @brief A one-to-many relation in compressed sparse row form: the dense IDs
+ * related to record i are ids[offsets[i] .. offsets[i + 1]), unless inserted
+ * plays have patched row i. Read rows with csr_row().
+ *
+ * Inserts leave offsets and ids alone (later generations share them) and
+ * write each row they change, in full, into the patch arrays instead. Once
+ * the patches grow past a budget they are folded into new base arrays.
+ */
+struct csr {
+    uint32_t *offsets;      // one more entry than there are records
+    uint32_t *ids;
+    bool borrowed;          // offsets and ids belong to a snapshot or a newer generation
+
+    uint32_t num_patched;   // rows with a patch
+    uint32_t *patch_rows;   // [num_patched] the patched rows, ascending
+    uint32_t *patch_offsets;    // row patch_rows[i] is patch_ids[patch_offsets[i] .. patch_offsets[i + 1])
+    uint32_t *patch_ids;
+};
+
+struct catalog {
+    struct track *tracks;           // sorted by track_id
+    uint32_t num_tracks;
+
+    struct album *albums;           // sorted by album_id
+    uint32_t num_albums;
+
+    struct playlist *playlists;     // sorted by playlist_id
+    uint32_t num_playlists;
+
+    const char **artists;           // distinct artist names, sorted (point into tracks)
+    uint32_t num_artists;
+
+    // Relations, indexed by dense ID
+    struct csr album_tracks;        // tracks on each album, ascending
+    struct csr track_albums;        // albums each track appears on, in CSV order
+    struct csr artist_albums;       // albums with a track by each artist, ascending
+    struct csr playlist_tracks;     // tracks in each playlist, ascending
+    uint32_t *track_artist;         // [num_tracks] artist of each track
+
+    // Substring search over track, album and playlist names and artists
+    struct trigram_index *track_names;
+    struct trigram_index *album_names;
+    struct trigram_index *playlist_names;
+    struct trigram_index *artist_names;
+
+    // Records listed in other orders than by ID, sorted on first use (see catalog_order())
+    uint32_t *orders[CATALOG_MAX_ORDERS];
+
+    // Which publish made this catalog current (0 for the first), set by the server
+    uint64_t generation;
+
+    // Set when the arrays above live in a mapped snapshot rather than the heap
+    void *map;
+    size_t map_size;
+
+    // Ownership once catalog_insert_plays() has derived a newer generation
+    // (each relation says for itself who owns its base arrays)
+    bool records_moved;             // records, artists and indexes belong to the newer generation
+};
+
+/**
+ * @brief Build the sorted arrays, relations and name indexes from the loaded
+ * plays and hash tables. The inputs are only read; the catalog owns copies of
+ * everything it keeps, so they can be freed as soon as this returns.
+ *
+ * @param num_threads threads to build with (capped at CATALOG_MAX_THREADS)
+ * @return struct catalog* the catalog, or NULL if out of memory
+ */
+struct catalog *catalog_create(struct slist *plays, struct htable *tracks, struct htable *albums,
+                               struct htable *playlists, uint32_t num_threads);
+
+/**
+ * @brief Free the catalog and all of its arrays (or unmap its snapshot).
+ */
+void catalog_destroy(struct catalog *cat);
+
+/**
+ * @brief The listing order kept in slot, or NULL if nobody has sorted it yet.
+ * What each slot holds is up to the caller; the catalog only keeps it.
+ */
+const uint32_t *catalog_order(struct catalog *cat, unsigned slot);
+
+/**
+ * @brief Keep order (malloc'd dense IDs; the catalog takes it over) in slot
+ * for the rest of the catalog's life. Readers may race to sort the same
+ * order: the first to get here wins, and a later copy is freed.
+ *
+ * @return const uint32_t* the order now in slot
+ */
+const uint32_t *catalog_keep_order(struct catalog *cat, unsigned slot, uint32_t *order);
+
+/**
+ * @brief The members of one row of a relation.
+ *
+ * @return const uint32_t* the row's dense IDs, *len of them
+ */
+const uint32_t *csr_row(const struct csr *rel, uint32_t row, uint32_t *len);
+
+/**
+ * @brief Dense ID of the track, album or playlist with the given Spotify ID
+ * (a binary search of the sorted records).
+ *
+ * @return uint32_t the dense ID, or CATALOG_NO_ID if there is no such record
+ */
+uint32_t catalog_track_id(const struct catalog *cat, const char *track_id);
+uint32_t catalog_album_id(const struct catalog *cat, const char *album_id);
+uint32_t catalog_playlist_id(const struct catalog *cat, const char *playlist_id);
+
+/**
+ * @brief Derive the next generation of cat with n more plays. Plays of
+ * records cat does not have are skipped, as are plays it already holds.
+ *
+ * Plays only relate existing records, so the records, artists and name
+ * indexes stay as they are and move to the new catalog without a copy. So do
+ * the base arrays of the four relations: only the rows the plays touch are
+ * merged with their new members and written as patches, and the patches cat
+ * already had are carried over. A relation whose patches outgrow their budget
+ * gets new base arrays instead, which costs a pass over the whole relation
+ * once in many inserts. cat stays fully readable (what moved is now owned by
+ * the new catalog, so it must not be read once that one is destroyed) and
+ * destroying it frees only what is still its own.
+ *
+ * @param num_new set to the number of plays that added something
+ * @return struct catalog* the new generation, or NULL when num_new is 0 (cat
+ * is unchanged and still owns everything) or out of memory
+ */
+struct catalog *catalog_insert_plays(struct catalog *cat, const struct play *plays, size_t n, size_t *num_new);
+
+#endif // SCATALOG_H
@@ -0,0 +1,279 @@
+/**
+ * @file scheck.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Self-checks run by `make check`.
+ * @version 0.1
+ * @date 2025-05-06
+ *
+ * @copyright Copyright (c) 2025
+ *
+ * Each check drives a module with many pseudo-random operations and compares
+ * every answer against a plain reference. The seed is fixed, so a failure
+ * repeats on every run.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "htable.h"
+#include "spotify.h"
+
+// Distinct keys the hash table check draws from, and operations it runs
+#define HT_KEYS 50000
+#define HT_STEPS 600000
+// Full comparison of the table with the reference every this many steps,
+// and more often while a rehash is in progress
+#define HT_CHECK_EVERY 9973
+#define HT_CHECK_REHASH_EVERY 499
+
+// Random numbers the parsing check compares with atof() and atoi()
+#define PARSE_CASES 1000000
+
+static int failures;
+
+static void fail(const char *check, const char *what, long step) {
+    fprintf(stderr, "FAIL %s: %s (step %ld)\n", check, what, step);
+    failures++;
+}
+
+// HASH TABLE ===============================================
+
+static char ht_keys[HT_KEYS][16];
+static int ht_vals[HT_KEYS];
+static int ht_alts[HT_KEYS];
+static void *ht_ref[HT_KEYS];  // expected value, NULL when the key is absent
+static uint32_t ht_count;
+
+/**
+ * @brief Compare everything the table holds, and how it iterates, copies and
+ * lists its values, against the reference.
+ */
+static void ht_compare(struct htable *ht, long step) {
+    if (htable_num_elems(ht) != ht_count) {
+        fail("htable", "num_elems differs from the reference", step);
+        return;
+    }
+
+    // Every key is found by content, not by the pointer it was inserted with
+    char probe[16];
+    for (uint32_t k = 0; k < HT_KEYS; k++) {
+        snprintf(probe, sizeof(probe), "%s", ht_keys[k]);
+        if (htable_find(ht, probe) != ht_ref[k]) {
+            fail("htable", "find disagrees with the reference", step);
+            return;
+        }
+    }
+
+    // The iterator visits every element once, in both arrays mid-rehash
+    static unsigned char seen[HT_KEYS];
+    memset(seen, 0, sizeof(seen));
+    uint32_t visited = 0;
+    struct htable_iter *iter = htable_create_iter(ht);
+    struct kv_pair *kv;
+    while ((kv = htable_iter_next(iter)) != NULL) {
+        uint32_t k = (uint32_t)atoi(kv->key + 1);
+        if (seen[k]++ || kv->value != ht_ref[k]) {
+            fail("htable", "iterator repeats a key or returns a stale value", step);
+            break;
+        }
+        visited++;
+    }
+    htable_destroy_iter(iter);
+    if (visited != ht_count) {
+        fail("htable", "iterator missed elements", step);
+    }
+
+    void **values = htable_values(ht);
+    uint64_t sum = 0, want = 0;
+    for (uint32_t i = 0; i < ht_count; i++) {
+        sum += (uint64_t)(uintptr_t)values[i];
+    }
+    for (uint32_t k = 0; k < HT_KEYS; k++) {
+        want += (uint64_t)(uintptr_t)ht_ref[k];
+    }
+    free(values);
+    if (sum != want) {
+        fail("htable", "values() differs from the reference", step);
+    }
+
+    struct htable *copy = htable_dupe(ht);
+    for (uint32_t k = 0; k < HT_KEYS; k++) {
+        if (htable_find(copy, ht_keys[k]) != ht_ref[k]) {
+            fail("htable", "dupe() differs from the original", step);
+            break;
+        }
+    }
+    htable_destroy(copy);
+}
+
+/**
+ * @brief Insert, look up, update and delete keys at random in a table that
+ * starts tiny, so it grows many times and many steps land mid-rehash.
+ */
+static void check_htable(void) {
+    for (uint32_t k = 0; k < HT_KEYS; k++) {
+        snprintf(ht_keys[k], sizeof(ht_keys[k]), "k%u", k);
+    }
+    struct htable *ht = htable_create(1);
+    long rehashing = 0;
+    srand(7);
+
+    for (long step = 0; step < HT_STEPS && failures == 0; step++) {
+        // Mostly inserts for the first half, mostly deletes after: the table fills, then drains
+        uint32_t k = (uint32_t)rand() % HT_KEYS;
+        int op = rand() % 8;
+        bool growing = step < HT_STEPS / 2;
+        if (op < 3) {
+            op = growing ? 0 : 4;
+        }
+
+        if (op == 0) {
+            bool added = htable_insert(ht, ht_keys[k], &ht_vals[k]);
+            if (added != (ht_ref[k] == NULL)) {
+                fail("htable", "insert added a present key or refused an absent one", step);
+            } else if (added) {
+                ht_ref[k] = &ht_vals[k];
+                ht_count++;
+            }
+        } else if (op == 3) {
+            bool inserted;
+            struct kv_pair *kv = htable_find_or_insert(ht, ht_keys[k], &inserted);
+            if (inserted != (ht_ref[k] == NULL) || (!inserted && kv->value != ht_ref[k])) {
+                fail("htable", "find_or_insert disagrees with the reference", step);
+            } else if (inserted) {
+                kv->value = &ht_vals[k];
+                ht_ref[k] = kv->value;
+                ht_count++;
+            }
+        } else if (op == 4) {
+            if (htable_del(ht, ht_keys[k]) != ht_ref[k]) {
+                fail("htable", "del returned the wrong value", step);
+            } else if (ht_ref[k]) {
+                ht_ref[k] = NULL;
+                ht_count--;
+            }
+        } else if (op == 5) {
+            void *next = ht_ref[k] == &ht_vals[k] ? (void *)&ht_alts[k] : (void *)&ht_vals[k];
+            if (htable_update(ht, ht_keys[k], next) != ht_ref[k]) {
+                fail("htable", "update returned the wrong old value", step);
+            } else if (ht_ref[k]) {
+                ht_ref[k] = next;
+            }
+        } else if (htable_find(ht, ht_keys[k]) != ht_ref[k]) {
+            fail("htable", "find disagrees with the reference", step);
+        }
+
+        if (htable_num_elems(ht) != ht_count) {
+            fail("htable", "num_elems differs from the reference", step);
+        }
+        if (ht->old_slots != NULL && step % HT_CHECK_REHASH_EVERY == 0) {
+            rehashing++;
+            ht_compare(ht, step);
+        } else if (step % HT_CHECK_EVERY == 0) {
+            ht_compare(ht, step);
+        }
+    }
+
+    htable_finish_rehash(ht);
+    if (ht->old_slots != NULL) {
+        fail("htable", "finish_rehash left old slots behind", HT_STEPS);
+    }
+    ht_compare(ht, HT_STEPS);
+    htable_destroy(ht);
+
+    if (rehashing == 0) {
+        fail("htable", "no comparison ran during a rehash", HT_STEPS);
+    }
+    printf("htable: %d steps, %ld full comparisons mid-rehash\n", HT_STEPS, rehashing);
+}
+
+// NUMBER PARSING ===========================================
+
+static void parse_compare(const char *s, long step) {
+    double got = parse_double(s), want = atof(s);
+    if (memcmp(&got, &want, sizeof(double)) != 0) {
+        fprintf(stderr, "parse_double(\"%s\") = %.17g, atof() = %.17g\n", s, got, want);
+        fail("parse", "parse_double differs from atof", step);
+    }
+    // atoi() is only defined for values that fit an int
+    long value = strtol(s, NULL, 10);
+    if (value >= INT32_MIN && value <= INT32_MAX && parse_int(s) != atoi(s)) {
+        fprintf(stderr, "parse_int(\"%s\") = %d, atoi() = %d\n", s, parse_int(s), atoi(s));
+        fail("parse", "parse_int differs from atoi", step);
+    }
+}
+
+/**
+ * @brief Append a run of 0 to max random digits.
+ */
+static char *put_digits(char *p, int max) {
+    for (int n = rand() % (max + 1); n > 0; n--) {
+        *p++ = (char)('0' + rand() % 10);
+    }
+    return p;
+}
+
+/**
+ * @brief Feed the fast parsers from spotify.c the numbers the CSV holds, the
+ * edges of their fast paths, and malformed text, and check they answer
+ * exactly what atof() and atoi() do.
+ */
+static void check_parse(void) {
+    static const char *edges[] = {
+        "0", "-0", "+0", "0.0", "-0.0", "1", "-1", "+7", "0.1", "0.2", "0.3", "-0.5", "4.35", "123.456",
+        "0.000001", "1e22", "1e23", "-1e22", "1e-22", "1e-23", "9007199254740992", "9007199254740993",
+        "9007199254740993.0", "99999999999999999", "100000000000000000", "123456789012345678901234",
+        "0.99999999999999999", "1.7976931348623157e308", "1e309", "4.9e-324", "1e-400", "2.5E3", "2.5e+3",
+        "2.5e-3", ".5", "5.", "-.5e2", "1e", "1e+", "e5", ".", "-", "+", "", "abc", "1.2.3", "12abc", " 7",
+        "\t-3", "0x10", "inf", "-nan", "2147483647", "-2147483648", "2147483648", "-2147483649", "007",
+        "-0012", "1e1000000000000",
+    };
+    long step = 0;
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        parse_compare(edges[i], step++);
+    }
+
+    srand(17);
+    char buf[64];
+    for (long i = 0; i < PARSE_CASES && failures == 0; i++) {
+        char *p = buf;
+        int sign = rand() % 4;
+        if (sign == 1) {
+            *p++ = '-';
+        } else if (sign == 2) {
+            *p++ = '+';
+        }
+        p = put_digits(p, rand() % 3 ? 6 : 20);
+        if (rand() % 2) {
+            *p++ = '.';
+            p = put_digits(p, rand() % 3 ? 6 : 20);
+        }
+        if (rand() % 4 == 0) {
+            *p++ = rand() % 2 ? 'e' : 'E';
+            if (rand() % 2) {
+                *p++ = rand() % 2 ? '-' : '+';
+            }
+            p = put_digits(p, 3);
+        }
+        if (rand() % 50 == 0) {
+            *p++ = "x. e-"[rand() % 5];
+        }
+        *p = '\0';
+        parse_compare(buf, step++);
+    }
+    printf("parse: %ld strings\n", step);
+}
+
+int main(void) {
+    check_htable();
+    check_parse();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -23,6 +23,7 @@
 #include <unistd.h>
 
 #include "spotify.h"
+#include "swire.h"
 
 /**
  * Capitalizes a string in place.
@@ -147,6 +148,31 @@ int parse_req(char *command, struct request_msg *req) {
             strncpy(req->args, tokens[2], sizeof(req->args) - 1);
             req->args[sizeof(req->args) - 1] = '\0';
         }
+    }
+    // Process INSERT PLAY <track> <album> <playlist> (PLAYS takes several, separated by ';')
+    else if (strcmp(cmd1, "INSERT") == 0) {
+        if (!tokens[1] || *tokens[1] == '\0') {
+            fprintf(stderr, "Error: Missing argument after %s\n", cmd1);
+            return 1;
+        }
+        char *cmd2 = tokens[1];
+        strcaps(cmd2);
+
+        if (strcmp(cmd2, "PLAY") == 0) {
+            req->command = INSERT_PLAY;
+        } else if (strcmp(cmd2, "PLAYS") == 0) {
+            req->command = INSERT_PLAYS;
+        } else {
+            fprintf(stderr, "Error: Invalid second argument \"%s\"\n", cmd2);
+            return 1;
+        }
+
+        if (!tokens[2] || *tokens[2] == '\0') {
+            fprintf(stderr, "Error: Missing track, album and playlist IDs for %s %s\n", cmd1, cmd2);
+            return 1;
+        }
+        strncpy(req->args, tokens[2], sizeof(req->args) - 1);
+        req->args[sizeof(req->args) - 1] = '\0';
     } else {
         fprintf(stderr, "Error: Unknown command \"%s\"\n", cmd1);
         return 1;
@@ -197,21 +223,89 @@ int connect_to(char *host, char *port)
 }
 
 
-int recv_response(int sockfd, struct response_msg *resp)
+/**
+ * @brief Receive exactly len bytes (recv() may return less on a large response).
+ *
+ * @return int 0, or -1 on an error or if the server hangs up first
+ */
+int recv_all(int sockfd, void *buf, size_t len)
+{
+	char *p = buf;
+	while (len > 0) {
+		ssize_t n = recv(sockfd, p, len, 0);
+		if (n <= 0) {
+			return -1;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/**
+ * @brief The check a v1 response with the same header and data carries.
+ */
+unsigned int v1_checksum(struct response_msg *resp)
+{
+	unsigned int received_check = resp->header.check;
+	resp->header.check = 0;
+	unsigned int check = compute_checksum(&resp->header, sizeof(resp->header), 1337);
+	if (resp->header.status == ERROR) {
+		check += compute_checksum(resp->error_message, sizeof(resp->error_message), check);
+	} else {
+		check += compute_checksum(resp->data.tracks, resp->header.num_tracks * sizeof(struct track), check);
+		check += compute_checksum(resp->data.albums, resp->header.num_albums * sizeof(struct album), check);
+		check += compute_checksum(resp->data.playlists, resp->header.num_playlists * sizeof(struct playlist), check);
+	}
+	resp->header.check = received_check;
+	return check;
+}
+
+/**
+ * @brief Receive a v2 frame (see swire.h) and unpack it into the same
+ * structs a v1 response fills.
+ */
+int recv_response_v2(int sockfd, struct response_msg *resp)
+{
+	unsigned char header[WIRE_V2_HEADER_SIZE];
+	uint32_t len;
+	if (recv_all(sockfd, header, sizeof(header)) < 0 || wire_v2_decode_header(header, &resp->header, &len) < 0) {
+		fprintf(stderr, "Error receiving response header\n");
+		return -1;
+	}
+
+	unsigned char *payload = malloc((size_t)len + 1);
+	if (!payload || recv_all(sockfd, payload, len) < 0 || wire_v2_decode_payload(header, payload, len, resp) < 0) {
+		fprintf(stderr, "Error receiving response data (or check sum mismatch)\n");
+		free(payload);
+		return -1;
+	}
+	free(payload);
+
+	// The frame's own check passed; print_response() checks the records
+	// against the check they would have carried in v1
+	resp->header.check = v1_checksum(resp);
+	return 0;
+}
+
+int recv_response(int sockfd, struct response_msg *resp, enum protocol_version protocol)
 {	
 	if (!resp || sockfd < 0){
 		fprintf(stderr, "Invalid response or socket\n");
 		return -1;		
 	}
+	if (protocol == PROTOCOL_V2) {
+		return recv_response_v2(sockfd, resp);
+	}
 	// Receive and parse response header
-	if (recv(sockfd, &resp->header, sizeof(struct response_header), 0) != sizeof(struct response_header)) {
+	if (recv_all(sockfd, &resp->header, sizeof(struct response_header)) < 0) {
 		perror("Error receiving response header");
 		return -1;
 	}
 
 	// Check status
 	if (resp->header.status == ERROR) {
-		if (recv(sockfd, &resp->error_message, sizeof(resp->error_message), 0) <= 0) {
+		if (recv_all(sockfd, &resp->error_message, sizeof(resp->error_message)) < 0) {
 			perror("Error receiving error message");
 			return -1;
 		}
@@ -227,7 +321,7 @@ int recv_response(int sockfd, struct response_msg *resp)
 				return -1;
 			}
 			// Receive data
-			if (recv(sockfd, resp->data.tracks, resp->header.num_tracks * sizeof(struct track), 0) != (ssize_t)(resp->header.num_tracks * sizeof(struct track))) {
+			if (recv_all(sockfd, resp->data.tracks, resp->header.num_tracks * sizeof(struct track)) < 0) {
 				perror("Error receiving tracks data");
 				return -1;
 			}
@@ -243,7 +337,7 @@ int recv_response(int sockfd, struct response_msg *resp)
 				return -1;
 			}
 			// Receive data
-			if (recv(sockfd, resp->data.albums, resp->header.num_albums * sizeof(struct album), 0) != (ssize_t)(resp->header.num_albums * sizeof(struct album))) {
+			if (recv_all(sockfd, resp->data.albums, resp->header.num_albums * sizeof(struct album)) < 0) {
 				perror("Error receiving albums data");
 				return -1;
 			}
@@ -259,13 +353,19 @@ int recv_response(int sockfd, struct response_msg *resp)
 				return -1;
 			}
 			// Receive data
-			if (recv(sockfd, resp->data.playlists, resp->header.num_playlists * sizeof(struct playlist), 0) != (ssize_t)(resp->header.num_playlists * sizeof(struct playlist))) {
+			if (recv_all(sockfd, resp->data.playlists, resp->header.num_playlists * sizeof(struct playlist)) < 0) {
 				perror("Error receiving playlists data");
 				return -1;
 			}
 		} else {
 			resp->data.playlists = NULL;
 		}
+
+		// A paged request is answered with its page after the records
+		if (resp->paged && recv_all(sockfd, &resp->page, sizeof(resp->page)) < 0) {
+			perror("Error receiving page");
+			return -1;
+		}
 		
 		return 0;
 	}
@@ -278,7 +378,7 @@ int recv_response(int sockfd, struct response_msg *resp)
 void free_resp(struct response_msg *resp) {
 	// This makes sure if resp is not available then we return
 	// We also return if there is an error message (thus no data)
-    if (!resp || resp->error_message) return;
+    if (!resp || resp->header.status == ERROR) return;
 
 	// Go through all of the data and check whether they exist (not NULL), then free
     if (resp->data.tracks) {
@@ -296,6 +396,27 @@ void free_resp(struct response_msg *resp) {
 }
 
 
+/**
+ * @brief Ask the server to answer this connection in v2 (the answer itself is v1).
+ *
+ * @return enum protocol_version v2, or v1 if the server refused or does not know SET_PROTOCOL
+ */
+enum protocol_version negotiate_protocol(int sockfd)
+{
+	struct request_msg req = {0};
+	req.command = SET_PROTOCOL;
+	strcpy(req.args, "2");
+	req.check = compute_checksum(&req, sizeof(req), 7331);
+
+	struct response_msg resp = {0};
+	if (send(sockfd, &req, sizeof(req), 0) != sizeof(req) || recv_response(sockfd, &resp, PROTOCOL_V1) < 0) {
+		return PROTOCOL_V1;
+	}
+	enum protocol_version protocol = resp.header.status == OK ? PROTOCOL_V2 : PROTOCOL_V1;
+	free_resp(&resp);
+	return protocol;
+}
+
 void print_response(struct response_msg *resp)
 {
 	// This function is complete. You should not need to modify it.
@@ -361,11 +482,31 @@ int main(int argc, char *argv[])
 	tzset();
 	char* host = NULL;
 	char* port = NULL;
-	if (argc == 3){
+	int compact = 1;	// ask every connection for v2 responses
+	int page_size = 0;	// results per page for SHOW and SEARCH; 0 for one response
+	int stream = 0;		// have SHOW and SEARCH answered as one stream of pages
+	int usage = argc < 3;
+	for (int i = 3; !usage && i < argc; i++) {
+		if (strcmp(argv[i], "--v1") == 0) {
+			compact = 0;
+		} else if (strcmp(argv[i], "--page") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+			page_size = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--stream") == 0) {
+			stream = 1;
+		} else {
+			usage = 1;
+		}
+	}
+	if (!usage){
 		host = argv[1];
 		port = argv[2];
 	} else	{
-		fprintf(stderr, "Usage: %s <host> <port>\n", argv[0]);
+		fprintf(stderr, "Usage: %s <host> <port> [--v1] [--page N] [--stream]\n"
+				"  --page and --stream need a server that accepts SET_PROTOCOL (v2 responses)\n", argv[0]);
+		return 1;
+	}
+	if (!compact && (page_size > 0 || stream)) {
+		fprintf(stderr, "--page and --stream need v2 responses, so they cannot be used with --v1\n");
 		return 1;
 	}
 
@@ -387,13 +528,15 @@ int main(int argc, char *argv[])
 		if (parse_req(cmd, &req)){
 			fprintf(stderr, "Invalid command: %s\n", cmd);
 			fprintf(stderr, "Commands:\n");
-			fprintf(stderr, "  show tracks <num>\n");
-			fprintf(stderr, "  show albums <num>\n");
-			fprintf(stderr, "  show artists <num>\n");
+			fprintf(stderr, "  show tracks <num> [by popularity|name|duration]\n");
+			fprintf(stderr, "  show albums <num> [by name|release date]\n");
+			fprintf(stderr, "  show playlists <num> [by name]\n");
 	
 			fprintf(stderr, "  search tracks <str>\n");
 			fprintf(stderr, "  search albums <str>\n");
-			fprintf(stderr, "  search artists <str>\n");			
+			fprintf(stderr, "  search artists <str>\n");
+			fprintf(stderr, "  insert play <track_id> <album_id> <playlist_id>\n");
+			fprintf(stderr, "  insert plays <track_id> <album_id> <playlist_id>; ...\n");
 			continue;
 		}
 
@@ -403,24 +546,57 @@ int main(int argc, char *argv[])
 			return 2;
 		}
 
-		if (send(sockfd, &req, sizeof(req), 0) != sizeof(req)) {
-			perror("Error sending data");
+		enum protocol_version protocol = compact ? negotiate_protocol(sockfd) : PROTOCOL_V1;
+
+		// Large results come a page at a time, each one printed before the next is asked for;
+		// a stream sends them all for the one request
+		int searching = req.command >= SHOW_TRACKS && req.command <= SEARCH_PLAYLISTS;
+		int paged = searching && (page_size > 0 || stream);
+		if (paged && protocol != PROTOCOL_V2) {
+			// Only a v2 header says whether a page follows; a server without SET_PROTOCOL never sends one
+			fprintf(stderr, "The server does not accept SET_PROTOCOL, so it cannot page: run without --page and --stream\n");
 			close(sockfd);
 			return 1;
 		}
-				
-		struct response_msg resp = {0};
-		if (recv_response(sockfd, &resp) < 0){
-			perror("recv");
-			return 4;
+		if (paged) {
+			req.limit = (uint32_t)page_size;
+			req.flags = stream ? REQUEST_STREAM : 0;
 		}
 
+		for (int first = 1;; first = 0) {
+			if (first || !stream) {
+				req.check = 0;
+				req.check = compute_checksum(&req, sizeof(struct request_msg), 7331);
+				if (send(sockfd, &req, sizeof(req), 0) != sizeof(req)) {
+					perror("Error sending data");
+					close(sockfd);
+					return 1;
+				}
+			}
 
-		// print the response
-		print_response(&resp);
+			struct response_msg resp = {0};
+			if (recv_response(sockfd, &resp, protocol) < 0){
+				perror("recv");
+				return 4;
+			}
 
-		// Free response
-		free_resp(&resp);
+			// print the response
+			print_response(&resp);
+			uint32_t next = 0;
+			if (resp.header.status == OK && resp.paged) {
+				// The cursor of the next page is one past the last result of this one
+				next = resp.page.next_cursor;
+				printf("Page: results %u to %u of %u\n", resp.page.first + 1,
+				       next ? next - 1 : resp.page.total, resp.page.total);
+			}
+
+			// Free response
+			free_resp(&resp);
+			if (next == 0) {
+				break;
+			}
+			req.cursor = next;
+		}
 
 		// close the socket
 		close(sockfd);
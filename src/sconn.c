@@ -0,0 +1,394 @@
+/**
+ * @file sconn.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Per-connection request framing and response queueing.
+ * @version 0.1
+ * @date 2025-03-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "spotify.h"
+#include "sconn.h"
+#include "swire.h"
+
+struct conn *conn_create(int fd) {
+    struct conn *c = (struct conn *)calloc(1, sizeof(struct conn));
+    if (!c) {
+        return NULL;
+    }
+    c->fd = fd;
+    c->protocol = PROTOCOL_V1;
+    return c;
+}
+
+void conn_destroy(struct conn *c) {
+    if (!c) return;
+
+    struct outmsg *m = c->out_front;
+    while (m) {
+        struct outmsg *next = m->next;
+        free_resp(&m->resp);
+        free(m->encoded);
+        if (m->stream) {
+            m->stream->destroy(m->stream);
+        }
+        if (m->cached) {
+            scache_release(m->cached);
+        }
+        free(m);
+        m = next;
+    }
+
+    close(c->fd);
+    free(c);
+}
+
+void free_resp(struct response_msg *resp) {
+    // This makes sure if resp is not available then we return
+    // We also return if there is an error message (thus no data, the union holds text)
+    if (!resp || resp->header.status == ERROR) return;
+
+    // Go through all of the data and check whether they exist (not NULL), then free
+    if (resp->data.tracks) {
+        free(resp->data.tracks);
+        resp->data.tracks = NULL;
+    }
+    if (resp->data.albums) {
+        free(resp->data.albums);
+        resp->data.albums = NULL;
+    }
+    if (resp->data.playlists) {
+        free(resp->data.playlists);
+        resp->data.playlists = NULL;
+    }
+}
+
+/**
+ * @brief Split a response into the contiguous pieces that go on the wire, in order.
+ *
+ * @return int number of segments written to ptrs/lens (at most RESP_MAX_SEGMENTS)
+ */
+static int resp_segments(struct response_msg *resp, const void **ptrs, size_t *lens) {
+    int n = 0;
+
+    ptrs[n] = &resp->header;
+    lens[n++] = sizeof(resp->header);
+
+    if (resp->header.status == ERROR) {
+        ptrs[n] = resp->error_message;
+        lens[n++] = sizeof(resp->error_message);
+        return n;
+    }
+
+    if (resp->header.num_tracks > 0) {
+        ptrs[n] = resp->data.tracks;
+        lens[n++] = sizeof(struct track) * resp->header.num_tracks;
+    }
+    if (resp->header.num_albums > 0) {
+        ptrs[n] = resp->data.albums;
+        lens[n++] = sizeof(struct album) * resp->header.num_albums;
+    }
+    if (resp->header.num_playlists > 0) {
+        ptrs[n] = resp->data.playlists;
+        lens[n++] = sizeof(struct playlist) * resp->header.num_playlists;
+    }
+    if (resp->paged) {
+        ptrs[n] = &resp->page;
+        lens[n++] = sizeof(resp->page);
+    }
+    return n;
+}
+
+size_t resp_wire_size(struct response_msg *resp) {
+    const void *ptrs[RESP_MAX_SEGMENTS];
+    size_t lens[RESP_MAX_SEGMENTS];
+    size_t total = 0;
+
+    int n = resp_segments(resp, ptrs, lens);
+    for (int i = 0; i < n; i++) {
+        total += lens[i];
+    }
+    return total;
+}
+
+unsigned char *resp_serialize(struct response_msg *resp, enum protocol_version protocol, size_t *len) {
+    if (protocol == PROTOCOL_V2) {
+        *len = wire_v2_size(resp);
+        unsigned char *out = (unsigned char *)malloc(*len);
+        if (out) {
+            wire_v2_encode(resp, out);
+        }
+        return out;
+    }
+
+    const void *ptrs[RESP_MAX_SEGMENTS];
+    size_t lens[RESP_MAX_SEGMENTS];
+    int n = resp_segments(resp, ptrs, lens);
+    *len = resp_wire_size(resp);
+    unsigned char *out = (unsigned char *)malloc(*len);
+    if (out) {
+        unsigned char *p = out;
+        for (int i = 0; i < n; i++) {
+            memcpy(p, ptrs[i], lens[i]);
+            p += lens[i];
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief The pieces of a queued response as they go on the wire: cached
+ * bytes, its v2 frame, or the v1 segments of resp.
+ */
+static int outmsg_segments(struct outmsg *m, const void **ptrs, size_t *lens) {
+    if (m->cached) {
+        ptrs[0] = m->cached->data;
+        lens[0] = m->cached->len;
+        return 1;
+    }
+    if (m->encoded) {
+        ptrs[0] = m->encoded;
+        lens[0] = m->total;
+        return 1;
+    }
+    return resp_segments(&m->resp, ptrs, lens);
+}
+
+/**
+ * @brief Size a freshly built response for the wire, encoding it first if it
+ * goes out in v2 (cached bytes already are in wire form).
+ *
+ * @return int 0, or -1 if out of memory
+ */
+static int outmsg_prepare(struct outmsg *m) {
+    if (m->cached) {
+        m->total = m->cached->len;
+    } else if (m->protocol == PROTOCOL_V2) {
+        m->total = wire_v2_size(&m->resp);
+        m->encoded = (unsigned char *)malloc(m->total);
+        if (!m->encoded) {
+            return -1;
+        }
+        wire_v2_encode(&m->resp, m->encoded);
+        free_resp(&m->resp);
+    } else {
+        m->total = resp_wire_size(&m->resp);
+    }
+    return 0;
+}
+
+/**
+ * @brief Replace the written frame of a stream with its next one.
+ *
+ * @return int 0, or -1 if out of memory (the stream is then dropped)
+ */
+static int outmsg_next_frame(struct outmsg *m) {
+    free_resp(&m->resp);
+    free(m->encoded);
+    m->encoded = NULL;
+    memset(&m->resp, 0, sizeof(m->resp));
+    m->sent = 0;
+
+    if (!m->stream->next(m->stream, &m->resp)) {
+        m->stream->destroy(m->stream);
+        m->stream = NULL;
+    }
+    if (outmsg_prepare(m) < 0) {
+        free_resp(&m->resp);
+        if (m->stream) {
+            m->stream->destroy(m->stream);
+            m->stream = NULL;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+enum conn_action conn_feed(struct conn *c, const char *data, size_t len, request_handler handler, void *ctx) {
+    while (len > 0) {
+        // Copy as much of the current request as this chunk holds
+        size_t want = sizeof(c->req) - c->req_len;
+        size_t take = len < want ? len : want;
+        memcpy((char *)&c->req + c->req_len, data, take);
+        c->req_len += take;
+        data += take;
+        len -= take;
+
+        if (c->req_len < sizeof(c->req)) {
+            break;  // Wait for the rest of the frame
+        }
+        c->req_len = 0;
+
+        struct outmsg *m = (struct outmsg *)calloc(1, sizeof(struct outmsg));
+        if (!m) {
+            fprintf(stderr, "Error: out of memory queueing response\n");
+            return CONN_CLOSE;
+        }
+
+        // The response is encoded as the connection stood when the request came in
+        m->protocol = c->protocol;
+        enum conn_action action = handler(&c->req, &m->resp, &c->protocol, &m->stream, &m->cached, ctx);
+        if (action != CONN_RESPOND || outmsg_prepare(m) < 0) {
+            if (action == CONN_RESPOND) {
+                fprintf(stderr, "Error: out of memory queueing response\n");
+                action = CONN_CLOSE;
+            }
+            free_resp(&m->resp);
+            if (m->stream) {
+                m->stream->destroy(m->stream);
+            }
+            if (m->cached) {
+                scache_release(m->cached);
+            }
+            free(m);
+            return action;
+        }
+
+        // Append to the write queue
+        if (c->out_back) {
+            c->out_back->next = m;
+        } else {
+            c->out_front = m;
+        }
+        c->out_back = m;
+        c->out_bytes += m->total;
+    }
+
+    return CONN_RESPOND;
+}
+
+enum conn_action conn_on_readable(struct conn *c, request_handler handler, void *ctx) {
+    char buf[CONN_RECV_CHUNK];
+
+    c->read_blocked = false;
+    while (!c->closing) {
+        // Apply backpressure: let the client wait until it has read what we owe it
+        if (c->out_bytes >= CONN_MAX_PENDING) {
+            c->read_blocked = true;
+            break;
+        }
+
+        ssize_t read_size = recv(c->fd, buf, sizeof(buf), 0);
+        if (read_size > 0) {
+            enum conn_action action = conn_feed(c, buf, (size_t)read_size, handler, ctx);
+            if (action != CONN_RESPOND) {
+                return action;
+            }
+        } else if (read_size == 0) {
+            // The client has closed its side; finish sending what we owe it.
+            printf("Client disconnected.\n");
+            c->closing = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            perror("recv failed");
+            return CONN_CLOSE;
+        }
+    }
+
+    return CONN_RESPOND;
+}
+
+int conn_pending_iov(struct conn *c, struct iovec *iov, int max_iov) {
+    int n = 0;
+
+    for (struct outmsg *m = c->out_front; m != NULL && n < max_iov; m = m->next) {
+        const void *ptrs[RESP_MAX_SEGMENTS];
+        size_t lens[RESP_MAX_SEGMENTS];
+        int nseg = outmsg_segments(m, ptrs, lens);
+
+        // Skip the part of this response that is already on the wire
+        size_t off = m->sent;
+        for (int i = 0; i < nseg && n < max_iov; i++) {
+            if (off >= lens[i]) {
+                off -= lens[i];
+                continue;
+            }
+            iov[n].iov_base = (char *)ptrs[i] + off;
+            iov[n].iov_len = lens[i] - off;
+            n++;
+            off = 0;
+        }
+        if (m->stream) {
+            break;  // The stream's next frame is not built yet
+        }
+    }
+
+    return n;
+}
+
+void conn_consume(struct conn *c, size_t n) {
+    c->out_bytes -= n;
+
+    while (c->out_front) {
+        struct outmsg *m = c->out_front;
+        size_t left = m->total - m->sent;
+        if (n < left) {
+            m->sent += n;
+            return;
+        }
+
+        // A stream stays at the front with its next frame in place of this one
+        n -= left;
+        if (m->stream) {
+            if (outmsg_next_frame(m) == 0) {
+                c->out_bytes += m->total;
+                continue;
+            }
+            fprintf(stderr, "Error: out of memory streaming response\n");
+            c->closing = true;
+        }
+
+        // Fully written, so pop it off the queue
+        c->out_front = m->next;
+        if (!c->out_front) {
+            c->out_back = NULL;
+        }
+        free_resp(&m->resp);
+        free(m->encoded);
+        if (m->cached) {
+            scache_release(m->cached);
+        }
+        free(m);
+        printf("Response sent.\n");
+    }
+}
+
+int conn_flush(struct conn *c) {
+    struct iovec iov[CONN_MAX_IOV];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+
+    while ((msg.msg_iovlen = conn_pending_iov(c, iov, CONN_MAX_IOV)) > 0) {
+        // A short write is fine: conn_consume() remembers where to resume
+        ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            perror("send failed");
+            return -1;
+        }
+        conn_consume(c, (size_t)n);
+    }
+
+    return 0;
+}
+
+bool conn_has_output(struct conn *c) {
+    return c->out_front != NULL;
+}
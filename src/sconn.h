@@ -0,0 +1,189 @@
+#ifndef SCONN_H
+#define SCONN_H
+
+/**
+ * @file sconn.h
+ * @brief Per-connection request framing and response queueing for sserver.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-03-14
+ *
+ * A connection owns a read state machine that assembles fixed-size
+ * struct request_msg frames out of whatever chunks the socket hands us,
+ * and a write queue of responses that are drained as the socket allows.
+ * The I/O backend (epoll, ...) only moves bytes; it never looks inside them.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "scache.h"
+#include "spotify.h"
+
+// Stop reading from a client while this many response bytes are still queued
+#define CONN_MAX_PENDING (4u * 1024 * 1024)
+
+// Size of the scratch buffer used for a single recv()
+#define CONN_RECV_CHUNK 4096
+
+// Pieces a v1 response goes out in: header, three record arrays and the page
+#define RESP_MAX_SEGMENTS 5
+
+// Most queued segments handed to a single sendmsg() (each response is at most RESP_MAX_SEGMENTS)
+#define CONN_MAX_IOV 64
+
+/**
+ * @brief What the request handler wants the connection to do next.
+ */
+enum conn_action {
+    CONN_RESPOND,   // queue the response and keep the connection open
+    CONN_CLOSE,     // drop the connection without responding
+    CONN_SHUTDOWN   // drop the connection and stop the server
+};
+
+/**
+ * @brief The frames of a streamed response after the first. The connection
+ * asks for each only once the one before it is written, so no more than one
+ * frame of a stream is ever held, and nothing queued behind the stream is
+ * sent until its last frame is.
+ */
+struct conn_stream {
+    // Build the next frame into resp (encoded like the first); false if it is the last
+    bool (*next)(struct conn_stream *s, struct response_msg *resp);
+    void (*destroy)(struct conn_stream *s);
+};
+
+/**
+ * @brief Builds the response for one complete request. protocol is the
+ * connection's response encoding (PROTOCOL_V1 when it opens); the handler may
+ * change it, starting with the response to the next request. To stream, the
+ * handler builds the first frame into resp and sets *stream to produce the
+ * rest; the connection destroys it after the last frame. To answer with bytes
+ * already in wire form, it sets *cached to an entry it holds a reference to
+ * instead; the connection sends them as they are and releases the entry.
+ */
+typedef enum conn_action (*request_handler)(struct request_msg *req, struct response_msg *resp,
+                                            enum protocol_version *protocol, struct conn_stream **stream,
+                                            struct scache_entry **cached, void *ctx);
+
+/**
+ * @brief A response waiting to be written, with the number of bytes already sent.
+ */
+struct outmsg {
+    struct response_msg resp;
+    unsigned char *encoded;     // v2 frame sent instead of resp (whose arrays are then freed)
+    enum protocol_version protocol;
+    struct conn_stream *stream; // builds the next frame into resp once this one is sent
+    struct scache_entry *cached;    // shared bytes sent instead of resp
+    size_t sent;
+    size_t total;
+    struct outmsg *next;
+};
+
+struct conn {
+    int fd;
+
+    // Read side: the request currently being assembled
+    struct request_msg req;
+    size_t req_len;
+    bool read_blocked;  // stopped reading because too much output is pending
+    enum protocol_version protocol;     // encoding of the responses queued from now on
+
+    // Write side: FIFO of responses
+    struct outmsg *out_front;
+    struct outmsg *out_back;
+    size_t out_bytes;
+
+    bool closing;   // close once the write queue drains
+
+    // Completion-based backends (io_uring) only
+    bool dead;                  // torn down; freed once nothing is in flight
+    bool recv_armed;            // a multishot recv is pending
+    uint32_t sends_inflight;    // sendmsg operations not yet completed
+    struct msghdr send_msg;     // describes the pending sendmsg; must outlive it
+    struct iovec send_iov[CONN_MAX_IOV];
+    unsigned retry;             // operations that found the submission queue full
+    struct conn *retry_next;    // in the event loop's retry list while retry is set
+
+    // Links in the owning event loop's list of live connections
+    struct conn *prev;
+    struct conn *next;
+};
+
+/**
+ * @brief Allocate a connection for an accepted, non-blocking socket.
+ */
+struct conn *conn_create(int fd);
+
+/**
+ * @brief Close the socket and free every queued response.
+ */
+void conn_destroy(struct conn *c);
+
+/**
+ * @brief Free the data arrays owned by a response (no-op for error responses).
+ */
+void free_resp(struct response_msg *resp);
+
+/**
+ * @brief Number of bytes the response occupies on the wire in v1.
+ */
+size_t resp_wire_size(struct response_msg *resp);
+
+/**
+ * @brief The response as one buffer of the bytes that go on the wire in the
+ * given encoding (the v1 check sum must already be set).
+ *
+ * @param len set to the buffer's size
+ * @return unsigned char* the malloc'd buffer, or NULL if out of memory
+ */
+unsigned char *resp_serialize(struct response_msg *resp, enum protocol_version protocol, size_t *len);
+
+/**
+ * @brief Feed received bytes into the request framer, calling the handler
+ * for every complete request.
+ *
+ * @return CONN_RESPOND to keep going, CONN_CLOSE or CONN_SHUTDOWN otherwise.
+ */
+enum conn_action conn_feed(struct conn *c, const char *data, size_t len, request_handler handler, void *ctx);
+
+/**
+ * @brief Drain the socket until it would block (or output backs up).
+ *
+ * @return CONN_RESPOND to keep going, CONN_CLOSE on EOF or error, CONN_SHUTDOWN on QUIT.
+ */
+enum conn_action conn_on_readable(struct conn *c, request_handler handler, void *ctx);
+
+/**
+ * @brief Describe the unsent bytes of the write queue, oldest first. A
+ * stream's current frame ends the list, since its next frame comes first.
+ *
+ * @param iov output array
+ * @param max_iov capacity of iov
+ * @return int number of iovec entries filled (0 when nothing is queued)
+ */
+int conn_pending_iov(struct conn *c, struct iovec *iov, int max_iov);
+
+/**
+ * @brief Mark n bytes of the write queue as sent, releasing finished responses
+ * and building the next frame of a stream whose frame was finished.
+ */
+void conn_consume(struct conn *c, size_t n);
+
+/**
+ * @brief Write queued responses until the queue is empty or the socket would block.
+ * Every sendmsg() carries as many queued segments as fit in CONN_MAX_IOV, so a
+ * header always leaves together with its payload.
+ *
+ * @return 0 on success (possibly with data still queued), -1 if the connection failed.
+ */
+int conn_flush(struct conn *c);
+
+/**
+ * @brief True when responses are still waiting to be written.
+ */
+bool conn_has_output(struct conn *c);
+
+#endif // SCONN_H
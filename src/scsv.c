@@ -0,0 +1,536 @@
+/**
+ * @file scsv.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Zero-copy loader for the Spotify songs CSV.
+ * @version 0.1
+ * @date 2025-04-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "scsv.h"
+#include "sscan.h"
+
+// Column positions in a row
+enum csv_field {
+    F_TRACK_ID, F_TRACK_NAME, F_ARTIST, F_POPULARITY,
+    F_ALBUM_ID, F_ALBUM_NAME, F_RELEASE_DATE,
+    F_PLAYLIST_NAME, F_PLAYLIST_ID, F_GENRE, F_SUBGENRE,
+    F_DANCEABILITY, F_ENERGY, F_KEY, F_LOUDNESS, F_MODE, F_SPEECHINESS,
+    F_ACOUSTICNESS, F_INSTRUMENTALNESS, F_LIVENESS, F_VALENCE, F_TEMPO, F_DURATION
+};
+
+// Bytes handed to csv_scan() at a time (grown for a row longer than this)
+#define CSV_SCAN_WINDOW (1u << 18)
+
+// Longest numeric field we bother reading (anything longer is not a number anyway)
+#define CSV_NUMBER_MAX 64
+
+/**
+ * @brief One field of the current row: bytes [start, end) of the mapping.
+ */
+struct span {
+    const char *start;
+    const char *end;
+};
+
+/**
+ * @brief Narrow a field the way clean_str() does, passes times: trim spaces,
+ * then peel off enclosing quotes. (Non-printable bytes become '-' only when
+ * the field is copied, and a '-' is never trimmed, so the order is the same.)
+ */
+static struct span clean_span(struct span f, int passes) {
+    for (int i = 0; i < passes; i++) {
+        while (f.start < f.end && *f.start == ' ') f.start++;
+        while (f.end > f.start && f.end[-1] == ' ') f.end--;
+        while (f.end - f.start > 1 && f.start[0] == '"' && f.end[-1] == '"') {
+            f.start++;
+            f.end--;
+        }
+    }
+    return f;
+}
+
+/**
+ * @brief Copy a cleaned field into its destination, NUL-terminated and
+ * truncated to cap - 1 bytes.
+ */
+static void copy_field(char *dst, size_t cap, struct span f) {
+    size_t len = (size_t)(f.end - f.start);
+    if (len > cap - 1) {
+        len = cap - 1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)f.start[i];
+        dst[i] = isprint(c) ? (char)c : '-';
+    }
+    dst[len] = '\0';
+}
+
+static void copy_text(char *dst, size_t cap, struct span f) {
+    copy_field(dst, cap, clean_span(f, 1));
+}
+
+// Fields read through strtok_quotes() were cleaned once there and once more by parse_line()
+static void copy_name(char *dst, size_t cap, struct span f) {
+    copy_field(dst, cap, clean_span(f, 2));
+}
+
+static double field_double(struct span f) {
+    char buf[CSV_NUMBER_MAX];
+    copy_text(buf, sizeof(buf), f);
+    return parse_double(buf);
+}
+
+static int field_int(struct span f) {
+    char buf[CSV_NUMBER_MAX];
+    copy_text(buf, sizeof(buf), f);
+    return parse_int(buf);
+}
+
+static time_t field_date(struct span f, struct date_cache *dates) {
+    char buf[CSV_NUMBER_MAX];
+    copy_text(buf, sizeof(buf), f);
+    return date_cache_lookup(dates, buf);
+}
+
+static struct track *make_track(const struct span *f) {
+    struct track *t = (struct track *)calloc(1, sizeof(struct track));
+    if (!t) {
+        return NULL;
+    }
+    copy_text(t->track_id, sizeof(t->track_id), f[F_TRACK_ID]);
+    copy_name(t->name, sizeof(t->name), f[F_TRACK_NAME]);
+    copy_name(t->artist, sizeof(t->artist), f[F_ARTIST]);
+    t->popularity = field_int(f[F_POPULARITY]);
+    t->danceability = field_double(f[F_DANCEABILITY]);
+    t->energy = field_double(f[F_ENERGY]);
+    t->key = field_double(f[F_KEY]);
+    t->loudness = field_double(f[F_LOUDNESS]);
+    t->speechiness = field_double(f[F_SPEECHINESS]);
+    t->acousticness = field_double(f[F_ACOUSTICNESS]);
+    t->instrumentalness = field_double(f[F_INSTRUMENTALNESS]);
+    t->liveness = field_double(f[F_LIVENESS]);
+    t->valence = field_double(f[F_VALENCE]);
+    t->tempo = field_double(f[F_TEMPO]);
+    t->duration_ms = field_int(f[F_DURATION]);
+    return t;
+}
+
+static struct album *make_album(const struct span *f, struct date_cache *dates) {
+    struct album *a = (struct album *)calloc(1, sizeof(struct album));
+    if (!a) {
+        return NULL;
+    }
+    copy_text(a->album_id, sizeof(a->album_id), f[F_ALBUM_ID]);
+    copy_name(a->name, sizeof(a->name), f[F_ALBUM_NAME]);
+    a->release_date = field_date(f[F_RELEASE_DATE], dates);
+    return a;
+}
+
+static struct playlist *make_playlist(const struct span *f) {
+    struct playlist *pl = (struct playlist *)calloc(1, sizeof(struct playlist));
+    if (!pl) {
+        return NULL;
+    }
+    copy_text(pl->playlist_id, sizeof(pl->playlist_id), f[F_PLAYLIST_ID]);
+    copy_name(pl->name, sizeof(pl->name), f[F_PLAYLIST_NAME]);
+    copy_text(pl->genre, sizeof(pl->genre), f[F_GENRE]);
+    copy_text(pl->subgenre, sizeof(pl->subgenre), f[F_SUBGENRE]);
+    return pl;
+}
+
+/**
+ * @brief One slice of the file, parsed by its own thread. Every chunk but the
+ * first fills private tables that are merged afterwards, in file order.
+ */
+struct csv_chunk {
+    pthread_t thread;
+    const char *start;
+    const char *end;
+    size_t quotes;              // '"' bytes in the nominal slice (used to place the split)
+
+    struct slist *plays;
+    struct htable *tracks;
+    struct htable *albums;
+    struct htable *playlists;
+    long count;                 // plays parsed, or -1 on failure
+    const char *bad_row;        // the short row, if that was the failure
+    struct date_cache *dates;   // release dates seen by this chunk's thread
+};
+
+/**
+ * @brief Add one row: always a play, and a track, album or playlist only the
+ * first time its ID shows up (later rows are not even parsed for them).
+ *
+ * @return int 0, or -1 if out of memory
+ */
+static int load_row(const struct span *f, struct csv_chunk *c) {
+    struct play *p = (struct play *)calloc(1, sizeof(struct play));
+    if (!p) {
+        return -1;
+    }
+    copy_text(p->track_id, sizeof(p->track_id), f[F_TRACK_ID]);
+    copy_text(p->album_id, sizeof(p->album_id), f[F_ALBUM_ID]);
+    copy_text(p->playlist_id, sizeof(p->playlist_id), f[F_PLAYLIST_ID]);
+    slist_add_back(c->plays, p);
+
+    // The play outlives the tables, so its IDs serve as their keys
+    bool inserted;
+    struct kv_pair *kv = htable_find_or_insert(c->tracks, p->track_id, &inserted);
+    if (!kv || (inserted && !(kv->value = make_track(f)))) {
+        return -1;
+    }
+    kv = htable_find_or_insert(c->albums, p->album_id, &inserted);
+    if (!kv || (inserted && !(kv->value = make_album(f, c->dates)))) {
+        return -1;
+    }
+    kv = htable_find_or_insert(c->playlists, p->playlist_id, &inserted);
+    if (!kv || (inserted && !(kv->value = make_playlist(f)))) {
+        return -1;
+    }
+    return 0;
+}
+
+static bool is_blank(struct span f) {
+    for (const char *c = f.start; c < f.end; c++) {
+        if (!isspace((unsigned char)*c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Add the row whose fields are f[0 .. nf) (nf may exceed the columns
+ * we know; the extra ones were not kept). A blank line is skipped.
+ *
+ * @return int 1 if a play was added, 0 if the line was blank, -1 on a short
+ * row or out of memory
+ */
+static int finish_row(const struct span *f, int nf, struct csv_chunk *c) {
+    if (nf == 1 && is_blank(f[0])) {
+        return 0;
+    }
+    if (nf < CSV_NUM_FIELDS) {
+        return -1;
+    }
+    return load_row(f, c) < 0 ? -1 : 1;
+}
+
+/**
+ * @brief Parse the chunk's rows into its tables (the header already skipped).
+ *
+ * The separators are found a window at a time by csv_scan(). A window always
+ * starts at a row, so outside quotes; the rows that end inside it are added,
+ * and the next window starts at the first row that does not (a window with
+ * no complete row is doubled and scanned again).
+ *
+ * @return long number of plays, or -1 on a short row or out of memory
+ */
+static long parse_rows(struct csv_chunk *c) {
+    const char *p = c->start;
+    const char *end = c->end;
+    long count = 0;
+    c->bad_row = NULL;
+
+    size_t window = CSV_SCAN_WINDOW;
+    uint32_t *seps = NULL;
+    size_t seps_cap = 0;
+
+    while (p < end) {
+        size_t len = (size_t)(end - p) < window ? (size_t)(end - p) : window;
+        if (seps_cap < len) {
+            uint32_t *grown = (uint32_t *)realloc(seps, len * sizeof(uint32_t));
+            if (!grown) {
+                count = -1;
+                break;
+            }
+            seps = grown;
+            seps_cap = len;
+        }
+        size_t num_seps = csv_scan(p, len, seps, SCAN_AUTO);
+        bool last = p + len == end;
+
+        struct span f[CSV_NUM_FIELDS];
+        int nf = 0;
+        const char *row = p;
+        const char *field = p;
+        int added = 0;
+        for (size_t i = 0; i < num_seps; i++) {
+            // Columns past the last one we know are ignored
+            const char *sep = p + seps[i];
+            if (nf < CSV_NUM_FIELDS) {
+                f[nf].start = field;
+                f[nf].end = sep;
+            }
+            nf++;
+            field = sep + 1;
+            if (*sep == '\n') {
+                if ((added = finish_row(f, nf, c)) < 0) {
+                    break;
+                }
+                count += added;
+                row = field;
+                nf = 0;
+            }
+        }
+
+        // The last row of the file need not end in a newline
+        if (added >= 0 && last && row < end) {
+            if (nf < CSV_NUM_FIELDS) {
+                f[nf].start = field;
+                f[nf].end = end;
+            }
+            nf++;
+            if ((added = finish_row(f, nf, c)) > 0) {
+                count += added;
+            }
+        }
+        if (added < 0) {
+            // A row with all its fields can only have failed for memory
+            if (nf < CSV_NUM_FIELDS) {
+                c->bad_row = row;
+            }
+            count = -1;
+            break;
+        }
+        if (last) {
+            break;
+        }
+        if (row == p) {
+            window *= 2;
+        }
+        p = row;
+    }
+    free(seps);
+    return count;
+}
+
+static void *count_quotes_main(void *arg) {
+    struct csv_chunk *c = (struct csv_chunk *)arg;
+    c->quotes = 0;
+    for (const char *q = c->start; (q = memchr(q, '"', (size_t)(c->end - q))) != NULL; q++) {
+        c->quotes++;
+    }
+    return NULL;
+}
+
+static void *parse_chunk_main(void *arg) {
+    struct csv_chunk *c = (struct csv_chunk *)arg;
+    c->dates = (struct date_cache *)calloc(1, sizeof(struct date_cache));
+    if (!c->plays || !c->tracks || !c->albums || !c->playlists || !c->dates) {
+        c->count = -1;
+    } else {
+        c->count = parse_rows(c);
+    }
+    free(c->dates);
+    return NULL;
+}
+
+/**
+ * @brief Run main on each of the first n chunks, one thread each, with the
+ * last one on the calling thread.
+ */
+static void run_chunks(struct csv_chunk *chunks, uint32_t n, void *(*main)(void *)) {
+    bool started[CSV_MAX_THREADS] = {false};
+    for (uint32_t i = 0; i + 1 < n; i++) {
+        started[i] = pthread_create(&chunks[i].thread, NULL, main, &chunks[i]) == 0;
+        if (!started[i]) {
+            main(&chunks[i]);
+        }
+    }
+    main(&chunks[n - 1]);
+    for (uint32_t i = 0; i + 1 < n; i++) {
+        if (started[i]) {
+            pthread_join(chunks[i].thread, NULL);
+        }
+    }
+}
+
+/**
+ * @brief First row boundary at or after p: the byte after a '\n' that is
+ * not inside quotes, given whether p itself is inside quotes.
+ */
+static const char *next_row(const char *p, const char *end, bool in_quotes) {
+    for (; p < end; p++) {
+        if (*p == '"') {
+            in_quotes = !in_quotes;
+        } else if (*p == '\n' && !in_quotes) {
+            return p + 1;
+        }
+    }
+    return end;
+}
+
+/**
+ * @brief Move every record of a chunk's table into the shared one unless an
+ * earlier chunk already holds that ID (first one wins, as in a serial load).
+ */
+static void merge_table(struct htable *into, struct htable *from) {
+    struct htable_iter iter = { from, 0 };
+    struct kv_pair *kv;
+    while ((kv = htable_iter_next(&iter)) != NULL) {
+        // Every record starts with its ID, which keys it from now on
+        bool inserted;
+        struct kv_pair *dst = htable_find_or_insert(into, (const char *)kv->value, &inserted);
+        if (dst && inserted) {
+            dst->value = kv->value;
+        } else {
+            free(kv->value);
+        }
+    }
+    htable_destroy(from);
+}
+
+static void free_table(struct htable *ht) {
+    if (!ht) return;
+    struct htable_iter iter = { ht, 0 };
+    struct kv_pair *kv;
+    while ((kv = htable_iter_next(&iter)) != NULL) {
+        free(kv->value);
+    }
+    htable_destroy(ht);
+}
+
+static long count_lines(const char *data, const char *upto) {
+    long n = 0;
+    for (const char *q = data; (q = memchr(q, '\n', (size_t)(upto - q))) != NULL; q++) {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Split [p, end) into up to num_threads chunks at row boundaries,
+ * parse them in parallel and fold them, in file order, into the shared
+ * structures.
+ */
+static long parse_parallel(const char *data, const char *p, const char *end, struct slist *plays,
+                           struct htable *tracks, struct htable *albums, struct htable *playlists,
+                           uint32_t num_threads) {
+    size_t body = (size_t)(end - p);
+    uint32_t n = num_threads;
+    if (n > CSV_MAX_THREADS) n = CSV_MAX_THREADS;
+    if (n > body / CSV_MIN_CHUNK) n = (uint32_t)(body / CSV_MIN_CHUNK);
+    if (n == 0) n = 1;
+
+    struct csv_chunk chunks[CSV_MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    for (uint32_t i = 0; i < n; i++) {
+        chunks[i].start = p + body * i / n;
+        chunks[i].end = p + body * (i + 1) / n;
+    }
+
+    // A split lands inside quotes when an odd number of quotes comes before it
+    // (every quote of well-formed CSV opens, closes or doubles one); from
+    // there the chunk starts at the next newline outside quotes
+    if (n > 1) {
+        run_chunks(chunks, n - 1, count_quotes_main);
+        bool in_quotes = false;
+        for (uint32_t i = 1; i < n; i++) {
+            in_quotes ^= chunks[i - 1].quotes & 1;
+            const char *nominal = chunks[i].start;
+            chunks[i].start = next_row(nominal, end, in_quotes);
+            if (chunks[i].start < chunks[i - 1].start) {
+                chunks[i].start = chunks[i - 1].start;
+            }
+        }
+        for (uint32_t i = 0; i + 1 < n; i++) {
+            chunks[i].end = chunks[i + 1].start;
+        }
+        chunks[n - 1].end = end;
+    }
+
+    // The first chunk goes straight into the shared structures
+    chunks[0].plays = plays;
+    chunks[0].tracks = tracks;
+    chunks[0].albums = albums;
+    chunks[0].playlists = playlists;
+    for (uint32_t i = 1; i < n; i++) {
+        chunks[i].plays = slist_create();
+        chunks[i].tracks = htable_create(1024);
+        chunks[i].albums = htable_create(1024);
+        chunks[i].playlists = htable_create(128);
+    }
+    run_chunks(chunks, n, parse_chunk_main);
+
+    long total = 0;
+    bool failed = false;
+    for (uint32_t i = 0; i < n; i++) {
+        if (!failed && chunks[i].count < 0) {
+            failed = true;
+            if (chunks[i].bad_row) {
+                fprintf(stderr, "Error parsing line %ld\n", count_lines(data, chunks[i].bad_row));
+            } else {
+                fprintf(stderr, "Error: out of memory loading the CSV\n");
+            }
+        }
+        if (i == 0) {
+            total = chunks[0].count;
+            continue;
+        }
+
+        if (failed) {
+            free_table(chunks[i].tracks);
+            free_table(chunks[i].albums);
+            free_table(chunks[i].playlists);
+            if (chunks[i].plays) slist_destroy(chunks[i].plays, 1);
+        } else {
+            merge_table(tracks, chunks[i].tracks);
+            merge_table(albums, chunks[i].albums);
+            merge_table(playlists, chunks[i].playlists);
+            slist_append_list(plays, chunks[i].plays);
+            slist_destroy(chunks[i].plays, 0);
+            total += chunks[i].count;
+        }
+    }
+    return failed ? -1 : total;
+}
+
+long csv_load(const char *path, struct slist *plays, struct htable *tracks, struct htable *albums,
+              struct htable *playlists, uint32_t num_threads) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("Error opening file");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("Error reading file");
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const char *data = (const char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Error mapping file");
+        return -1;
+    }
+    madvise((void *)data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    // Skip the header row
+    const char *end = data + st.st_size;
+    const char *p = (const char *)memchr(data, '\n', (size_t)st.st_size);
+    p = p ? p + 1 : end;
+
+    long count = parse_parallel(data, p, end, plays, tracks, albums, playlists, num_threads);
+    munmap((void *)data, (size_t)st.st_size);
+    return count;
+}
@@ -0,0 +1,51 @@
+#ifndef SCSV_H
+#define SCSV_H
+
+/**
+ * @file scsv.h
+ * @brief Zero-copy loader for the Spotify songs CSV.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-04-14
+ *
+ * The file is mapped into memory and split into fields in place, from the
+ * separator offsets csv_scan() finds with SIMD compares (RFC 4180 quoting:
+ * commas or newlines inside quotes are data, and "" stands for a literal
+ * quote). Nothing is tokenized into temporary strings: every field is a span
+ * of the mapping, and only the spans that end up in a record are copied,
+ * straight into that record.
+ *
+ * Fields are cleaned the way clean_str() does it, so the records match what
+ * read_csv_to_lists() builds: non-printable bytes become '-', surrounding
+ * spaces are trimmed and enclosing quotes removed.
+ */
+
+#include <stdint.h>
+
+#include "htable.h"
+#include "slist.h"
+#include "spotify.h"
+
+// Columns in a row of the songs CSV (track_id .. duration_ms)
+#define CSV_NUM_FIELDS 23
+
+// Most threads csv_load() parses with, and the least input worth a thread
+#define CSV_MAX_THREADS 64
+#define CSV_MIN_CHUNK (1u << 20)
+
+/**
+ * @brief Load every play in the CSV at path, skipping the header row.
+ * Every play is appended to plays in file order; tracks, albums and
+ * playlists keep the first record in the file for each ID (keyed by an ID
+ * string inside the play or the record).
+ *
+ * Large files are split at row boundaries into up to num_threads chunks
+ * that are parsed in parallel into private tables, then merged in file
+ * order, so the result is the same as a serial load.
+ *
+ * @return long number of plays loaded, or -1 if the file cannot be read or
+ * a row has fewer than CSV_NUM_FIELDS fields (reported on stderr)
+ */
+long csv_load(const char *path, struct slist *plays, struct htable *tracks, struct htable *albums,
+              struct htable *playlists, uint32_t num_threads);
+
+#endif // SCSV_H
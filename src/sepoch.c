@@ -0,0 +1,63 @@
+/**
+ * @file sepoch.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief A shared pointer that can be replaced while readers are using it.
+ * @version 0.1
+ * @date 2025-04-24
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sepoch.h"
+
+// How long epoch_publish() sleeps between looks at a reader still inside
+#define EPOCH_POLL_NS 100000
+
+int epoch_init(struct epoch *e, void *initial, uint32_t num_readers) {
+    size_t size = (size_t)(num_readers > 0 ? num_readers : 1) * sizeof(struct epoch_reader);
+    e->readers = (struct epoch_reader *)aligned_alloc(EPOCH_SLOT_SIZE, size);
+    if (!e->readers) {
+        return -1;
+    }
+    memset(e->readers, 0, size);
+    e->current = initial;
+    e->generation = 0;
+    e->num_readers = num_readers;
+    return 0;
+}
+
+void epoch_destroy(struct epoch *e) {
+    free(e->readers);
+    e->readers = NULL;
+}
+
+void *epoch_enter(struct epoch *e, uint32_t reader) {
+    // Both sequentially consistent: a publisher that reads this slot before
+    // the increment has already swapped, so the load sees the new pointer;
+    // one that reads it after waits for the matching epoch_exit()
+    __atomic_fetch_add(&e->readers[reader].seq, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&e->current, __ATOMIC_SEQ_CST);
+}
+
+void epoch_exit(struct epoch *e, uint32_t reader) {
+    __atomic_fetch_add(&e->readers[reader].seq, 1, __ATOMIC_RELEASE);
+}
+
+void *epoch_publish(struct epoch *e, void *next) {
+    void *prev = __atomic_exchange_n(&e->current, next, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&e->generation, 1, __ATOMIC_RELAXED);
+
+    // A reader inside now may hold prev; it is done once its number moves on
+    const struct timespec poll = { 0, EPOCH_POLL_NS };
+    for (uint32_t r = 0; r < e->num_readers; r++) {
+        uint64_t seq = __atomic_load_n(&e->readers[r].seq, __ATOMIC_SEQ_CST);
+        while ((seq & 1) && __atomic_load_n(&e->readers[r].seq, __ATOMIC_ACQUIRE) == seq) {
+            nanosleep(&poll, NULL);
+        }
+    }
+    return prev;
+}
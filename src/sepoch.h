@@ -0,0 +1,65 @@
+#ifndef SEPOCH_H
+#define SEPOCH_H
+
+/**
+ * @file sepoch.h
+ * @brief A shared pointer that can be replaced while readers are using it.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-04-24
+ *
+ * Each reader thread owns a slot with a sequence number that is odd while
+ * the reader is inside epoch_enter() .. epoch_exit(). epoch_publish() swaps
+ * in the new pointer, then waits only for the readers that were inside at
+ * that moment to step out: any reader entering later already sees the new
+ * pointer, so once those few have left nothing can still hold the old one
+ * and the caller may free it. Readers never lock or wait; entering and
+ * leaving is one atomic increment each, on a cache line of their own.
+ */
+
+#include <stdint.h>
+
+// Reader slots are padded to this, so readers never share a cache line
+#define EPOCH_SLOT_SIZE 64
+
+struct epoch_reader {
+    uint64_t seq;                   // odd while the reader is in a read section
+    char pad[EPOCH_SLOT_SIZE - sizeof(uint64_t)];
+};
+
+struct epoch {
+    void *current;
+    uint64_t generation;            // publishes so far
+    uint32_t num_readers;
+    struct epoch_reader *readers;
+};
+
+/**
+ * @brief Start publishing initial to readers 0..num_readers-1.
+ *
+ * @return int 0, or -1 if out of memory
+ */
+int epoch_init(struct epoch *e, void *initial, uint32_t num_readers);
+
+/**
+ * @brief Free the reader slots (the current pointer is the caller's).
+ */
+void epoch_destroy(struct epoch *e);
+
+/**
+ * @brief Enter a read section as the given reader and get the current
+ * pointer, which stays valid until the matching epoch_exit(). Sections of
+ * one reader must not nest.
+ */
+void *epoch_enter(struct epoch *e, uint32_t reader);
+
+void epoch_exit(struct epoch *e, uint32_t reader);
+
+/**
+ * @brief Make next the current pointer and wait until no reader can still
+ * be using the previous one. Only one thread may publish at a time.
+ *
+ * @return void* the previous pointer, now safe to free
+ */
+void *epoch_publish(struct epoch *e, void *next);
+
+#endif // SEPOCH_H
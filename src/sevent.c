@@ -0,0 +1,275 @@
+/**
+ * @file sevent.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Edge-triggered epoll event loop for sserver.
+ * @version 0.1
+ * @date 2025-03-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#define _GNU_SOURCE  // accept4
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "sconn.h"
+#include "sevent.h"
+
+// How long accepting pauses after running out of descriptors or memory
+#define ACCEPT_BACKOFF_MS 100
+
+struct sevent {
+    int epfd;
+    int listen_fd;
+    int wake_fd;
+    int timer_fd;           // re-adds the listener once an accept backoff is over
+    bool accept_failing;    // the last accept failed; reported once per run of failures
+    struct conn *conns;     // every live connection, for cleanup on exit
+    request_handler handler;
+    void *ctx;
+    volatile sig_atomic_t *running;
+};
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void sevent_close(struct sevent *loop, struct conn *c) {
+    // epoll drops the fd on close(), so only the registry needs unlinking
+    if (c->prev) {
+        c->prev->next = c->next;
+    } else {
+        loop->conns = c->next;
+    }
+    if (c->next) {
+        c->next->prev = c->prev;
+    }
+    conn_destroy(c);
+}
+
+/**
+ * @brief Stop watching the listener for ACCEPT_BACKOFF_MS. It is level
+ * triggered, so while out of descriptors or memory the connection waiting in
+ * the backlog would wake the loop again at once, only to fail again.
+ */
+static void sevent_accept_later(struct sevent *loop) {
+    struct itimerspec delay = {0};
+    delay.it_value.tv_nsec = ACCEPT_BACKOFF_MS * 1000000L;
+    if (timerfd_settime(loop->timer_fd, 0, &delay, NULL) < 0) {
+        perror("timerfd_settime failed");
+        return;     // Keep accepting at once rather than never again
+    }
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_DEL, loop->listen_fd, NULL) < 0) {
+        perror("epoll_ctl failed");
+    }
+}
+
+/**
+ * @brief Watch the listener again once the accept backoff is over.
+ */
+static void sevent_accept_resume(struct sevent *loop) {
+    uint64_t expirations;
+    if (read(loop->timer_fd, &expirations, sizeof(expirations)) < 0) {
+        return;     // Not expired after all
+    }
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->listen_fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+    }
+}
+
+/**
+ * @brief Accept every pending connection on the listening socket.
+ */
+static void sevent_accept(struct sevent *loop) {
+    while (1) {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int fd = accept4(loop->listen_fd, (struct sockaddr *)&address, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (!loop->accept_failing) {
+                perror("Accept failed");
+                loop->accept_failing = true;
+            }
+            if (errno == EMFILE || errno == ENFILE || errno == ENOMEM || errno == ENOBUFS) {
+                // Leave the rest in the backlog until descriptors or memory free up
+                sevent_accept_later(loop);
+            }
+            return;
+        }
+        loop->accept_failing = false;
+
+        struct conn *c = conn_create(fd);
+        if (!c) {
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = c;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            conn_destroy(c);
+            continue;
+        }
+
+        c->next = loop->conns;
+        if (loop->conns) {
+            loop->conns->prev = c;
+        }
+        loop->conns = c;
+
+        printf("Connection accepted from %s:%d\n", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+    }
+}
+
+/**
+ * @brief Advance one connection's read and write state machines.
+ */
+static void sevent_handle(struct sevent *loop, struct conn *c, uint32_t events) {
+    enum conn_action action = CONN_RESPOND;
+
+    if (events & EPOLLERR) {
+        action = CONN_CLOSE;
+    } else if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && !c->read_blocked) {
+        action = conn_on_readable(c, loop->handler, loop->ctx);
+    }
+
+    // Write what we can; if reading was paused for backpressure and the
+    // queue has drained, resume it (edge-triggered: no new EPOLLIN will come)
+    while (action == CONN_RESPOND) {
+        if (conn_flush(c) < 0) {
+            action = CONN_CLOSE;
+            break;
+        }
+        if (!c->read_blocked || c->out_bytes >= CONN_MAX_PENDING) {
+            break;
+        }
+        action = conn_on_readable(c, loop->handler, loop->ctx);
+    }
+
+    if (action == CONN_RESPOND && c->closing && !conn_has_output(c)) {
+        action = CONN_CLOSE;
+    }
+
+    if (action == CONN_SHUTDOWN) {
+        *loop->running = 0;
+        if (loop->wake_fd >= 0) {
+            eventfd_write(loop->wake_fd, 1);
+        }
+    }
+    if (action != CONN_RESPOND) {
+        printf("Disconnecting\n");
+        sevent_close(loop, c);
+    }
+}
+
+int sevent_run(int listen_fd, int wake_fd, request_handler handler, void *ctx, volatile sig_atomic_t *running) {
+    struct sevent loop = {0};
+    loop.listen_fd = listen_fd;
+    loop.wake_fd = wake_fd;
+    loop.timer_fd = -1;
+    loop.handler = handler;
+    loop.ctx = ctx;
+    loop.running = running;
+
+    if (set_nonblocking(listen_fd) < 0) {
+        perror("fcntl failed");
+        return -1;
+    }
+
+    loop.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop.epfd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+
+    // A NULL data pointer marks the listening socket
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        close(loop.epfd);
+        return -1;
+    }
+
+    loop.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ev.events = EPOLLIN;
+    ev.data.ptr = &loop.timer_fd;
+    if (loop.timer_fd < 0 || epoll_ctl(loop.epfd, EPOLL_CTL_ADD, loop.timer_fd, &ev) < 0) {
+        perror("timerfd failed");
+        if (loop.timer_fd >= 0) {
+            close(loop.timer_fd);
+        }
+        close(loop.epfd);
+        return -1;
+    }
+
+    // The wake fd is never drained, so it stays readable for every loop
+    if (wake_fd >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = &loop.wake_fd;
+        if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, wake_fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            close(loop.timer_fd);
+            close(loop.epfd);
+            return -1;
+        }
+    }
+
+    struct epoll_event events[SEVENT_MAX_EVENTS];
+    while (*running) {
+        int n = epoll_wait(loop.epfd, events, SEVENT_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;   // Signal: re-check *running
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < n && *running; i++) {
+            if (events[i].data.ptr == NULL) {
+                sevent_accept(&loop);
+            } else if (events[i].data.ptr == &loop.wake_fd) {
+                continue;   // Only here to break epoll_wait; *running says why
+            } else if (events[i].data.ptr == &loop.timer_fd) {
+                sevent_accept_resume(&loop);
+            } else {
+                sevent_handle(&loop, (struct conn *)events[i].data.ptr, events[i].events);
+            }
+        }
+    }
+
+    // Tear down whatever is still connected
+    while (loop.conns) {
+        sevent_close(&loop, loop.conns);
+    }
+    close(loop.timer_fd);
+    close(loop.epfd);
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef SEVENT_H
+#define SEVENT_H
+
+/**
+ * @file sevent.h
+ * @brief Edge-triggered epoll event loop for sserver.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-03-14
+ */
+
+#include <signal.h>
+
+#include "sconn.h"
+
+// Maximum number of events handled per epoll_wait() call
+#define SEVENT_MAX_EVENTS 256
+
+/**
+ * @brief Serve every connection accepted on listen_fd from a single thread
+ * until *running becomes zero or a handler asks for shutdown.
+ *
+ * The listening socket is switched to non-blocking mode. Each accepted
+ * client gets its own struct conn; slow or idle clients never stall others.
+ *
+ * wake_fd (an eventfd, or -1) is shared by every loop in the process: once it
+ * becomes readable all loops re-check *running. A loop that sees a shutdown
+ * request clears *running and signals wake_fd so its siblings exit too.
+ *
+ * @return int 0 on a clean exit, -1 if the loop could not be set up.
+ */
+int sevent_run(int listen_fd, int wake_fd, request_handler handler, void *ctx, volatile sig_atomic_t *running);
+
+#endif // SEVENT_H
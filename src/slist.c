@@ -88,6 +88,29 @@ slist_add_back(struct slist *l, void *ptr) {
     return;
 }
 
+void
+slist_append_list(struct slist *l, struct slist *other) {
+
+    if (other->front == NULL) {
+        return;
+    }
+
+    // Splice other's chain after our back node
+    if (l->back == NULL) {
+        l->front = other->front;
+    } else {
+        l->back->next = other->front;
+    }
+    l->back = other->back;
+    l->counter += other->counter;
+
+    other->front = NULL;
+    other->back = NULL;
+    other->counter = 0;
+
+    return;
+}
+
 void **
 slist_to_array(struct slist *l) {
     // Allocate an array of enough size for number of strings
@@ -59,6 +59,15 @@ void slist_add_back(struct slist *l, void *ptr);
 void slist_add_front(struct slist *l, void *ptr);
 
 
+/**
+ * Moves every node of other to the back of l (no nodes are copied),
+ * leaving other empty.
+ *
+ * @param l pointer to the list (non-NULL)
+ * @param other pointer to the list to empty into l (non-NULL)
+ */
+void slist_append_list(struct slist *l, struct slist *other);
+
 /**
  * Convert the singly-linked list to an array of snode pointers.
  */
@@ -56,6 +56,104 @@ time_t string_to_linux_time(const char* date_string) {
   return mktime(&parsed_time);
 }
 
+// Powers of ten that are exact doubles, for parse_double()'s fast path
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+double parse_double(const char *s) {
+	const char *p = s;
+	int negative = *p == '-';
+	if (*p == '-' || *p == '+') {
+		p++;
+	}
+
+	// Gather the digits into an integer mantissa and a power of ten
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	for (; *p >= '0' && *p <= '9'; p++, digits++) {
+		if (mantissa >= 100000000000000000ULL) {
+			return atof(s);
+		}
+		mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+	}
+	if (*p == '.') {
+		for (p++; *p >= '0' && *p <= '9'; p++, digits++) {
+			if (mantissa >= 100000000000000000ULL) {
+				return atof(s);
+			}
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			exponent--;
+		}
+	}
+	if (digits == 0) {
+		return atof(s);
+	}
+	if (*p == 'e' || *p == 'E') {
+		p++;
+		int exp_negative = *p == '-';
+		if (*p == '-' || *p == '+') {
+			p++;
+		}
+		if (*p < '0' || *p > '9') {
+			return atof(s);
+		}
+		int e = 0;
+		for (; *p >= '0' && *p <= '9' && e < 1000; p++) {
+			e = e * 10 + (*p - '0');
+		}
+		exponent += exp_negative ? -e : e;
+	}
+
+	// Both operands exact, so the one rounding is the correctly rounded result
+	if (*p != '\0' || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) {
+		return atof(s);
+	}
+	double value = (double)mantissa;
+	value = exponent < 0 ? value / exact_pow10[-exponent] : value * exact_pow10[exponent];
+	return negative ? -value : value;
+}
+
+int parse_int(const char *s) {
+	const char *p = s;
+	int negative = *p == '-';
+	if (*p == '-' || *p == '+') {
+		p++;
+	}
+	if (*p < '0' || *p > '9') {
+		return atoi(s);
+	}
+	long value = 0;
+	for (int digits = 0; *p >= '0' && *p <= '9'; p++, digits++) {
+		if (digits == 18) {
+			return atoi(s);
+		}
+		value = value * 10 + (*p - '0');
+	}
+	return (int)(negative ? -value : value);
+}
+
+time_t date_cache_lookup(struct date_cache *cache, const char *date) {
+	size_t len = strlen(date);
+	if (len == 0 || len >= DATE_CACHE_KEY) {
+		return string_to_linux_time(date);
+	}
+
+	// FNV-1a picks the slot; a different date there is simply replaced
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ (unsigned char)date[i]) * 16777619u;
+	}
+	size_t slot = hash & (DATE_CACHE_SLOTS - 1);
+	if (strcmp(cache->slots[slot].date, date) != 0) {
+		memcpy(cache->slots[slot].date, date, len + 1);
+		cache->slots[slot].when = string_to_linux_time(date);
+	}
+	return cache->slots[slot].when;
+}
+
 /**
  * Clean up a string by removing non-printable characters, leading and trailing spaces, and quotes in place.
  */
@@ -82,8 +180,8 @@ char* clean_str(char *token) {
 		token ++;
 		len -= 1;
 	}
-	// strip trailing spaces
-	while (isspace(token[len-1])) {
+	// strip trailing spaces (an all-space token ends up empty)
+	while (len > 0 && isspace(token[len-1])) {
 		token[len-1] = '\0';
 		len -= 1;
 	}
@@ -125,6 +223,9 @@ char* strtok_quotes(char *str, const char *delim) {
 	return clean_str(token);
 }
 
+// parse_line() is not reentrant (strtok), so one cache serves every call
+static struct date_cache parse_line_dates;
+
 int 
 parse_line(char *line, 
 	struct play *p, 
@@ -163,7 +264,7 @@ parse_line(char *line,
 	if (token == NULL) {
 		return 0;
 	}
-	t->popularity = atoi(token);
+	t->popularity = parse_int(token);
 
 	// album id
 	token = clean_str(strtok(NULL, ","));
@@ -185,7 +286,7 @@ parse_line(char *line,
 	if (token == NULL) {
 		return 0;
 	}
-	a->release_date = string_to_linux_time(token);
+	a->release_date = date_cache_lookup(&parse_line_dates, token);
 
 	// playlist name
 	token = clean_str(strtok_quotes(NULL, ","));
@@ -221,25 +322,25 @@ parse_line(char *line,
 	if (token == NULL) {
 		return 0;
 	}
-	t->danceability = atof(token);
+	t->danceability = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->energy = atof(token);
+	t->energy = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->key = atof(token);
+	t->key = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->loudness = atof(token);
+	t->loudness = parse_double(token);
 
 	// Skip mode?
 	token = strtok(NULL, ",");
@@ -248,43 +349,43 @@ parse_line(char *line,
 	if (token == NULL) {
 		return 0;
 	}
-	t->speechiness = atof(token);
+	t->speechiness = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->acousticness = atof(token);
+	t->acousticness = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->instrumentalness = atof(token);
+	t->instrumentalness = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->liveness = atof(token);
+	t->liveness = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->valence = atof(token);
+	t->valence = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->tempo = atof(token);
+	t->tempo = parse_double(token);
 
 	token = clean_str(strtok(NULL, ","));
 	if (token == NULL) {
 		return 0;
 	}
-	t->duration_ms = atoi(token);
+	t->duration_ms = parse_int(token);
      
 
 	// for fields that can be quoted, use strtok_quotes!
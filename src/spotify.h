@@ -19,7 +19,16 @@ enum command_id {
     SEARCH_ALBUMS,
     SEARCH_ARTISTS,
     SEARCH_PLAYLISTS,
-    QUIT
+    QUIT,
+    INSERT_PLAY,    // args: "track_id album_id playlist_id"
+    INSERT_PLAYS,   // args: as many of those as fit, separated by ';'
+    SET_PROTOCOL    // args: "1" or "2", the encoding of the responses that follow (see swire.h)
+};
+
+// Response encodings a connection can switch between with SET_PROTOCOL
+enum protocol_version {
+    PROTOCOL_V1 = 1,    // the fixed-size structs, as in memory
+    PROTOCOL_V2 = 2     // length-prefixed strings and packed numbers
 };
 
 // Status Codes (enum)
@@ -33,7 +42,8 @@ enum error_type {
 	INVALID_CMD_ERR,
 	ZERO_ARGS_ERR,
 	NO_RESULTS_ERR,
-	UNKNOWN_ERR
+	UNKNOWN_ERR,
+	UNKNOWN_ID_ERR
 };
 
 // Response Types (enum)
@@ -45,12 +55,48 @@ enum response_id {
     NONE
 };
  
+/**
+ * Paging: a request with limit 0 gets every result, as it always has. With a
+ * limit it gets at most that many primary results (the records searched or
+ * shown: tracks for SEARCH_TRACKS, albums for SEARCH_ARTISTS, ...) plus the
+ * records joined to those alone, starting at offset, or where the cursor of
+ * the previous page says. An offset or cursor without a limit gets pages of
+ * DEFAULT_PAGE_RESULTS, rather than being ignored.
+ *
+ * Streaming: with REQUEST_STREAM in flags, a SHOW or SEARCH request is
+ * answered with every page from there to the end, one after another, each a
+ * complete paged response with its own counts and check sum. The pages hold
+ * limit primary results each (DEFAULT_PAGE_RESULTS when limit is 0), and the
+ * last one has next_cursor 0.
+ *
+ * These fields take the last bytes of what used to be args[256], so the
+ * struct and its checksum keep their size and place. The server reads them
+ * only on a connection that has switched to v2 with SET_PROTOCOL, since a
+ * client that knows them knows v2. On a v1 connection they are still the
+ * tail of REQUEST_V1_ARGS bytes of args, as they always were.
+ */
 struct request_msg
 {
 	enum command_id command;			// command (see )			
-	char args[256];		// arguments (max 4 up to 256 chars each)
+	char args[240];		// arguments (max 4 up to 240 chars each)
+	uint32_t offset;	// first primary result to return (with limit)
+	uint32_t limit;		// primary results per page; 0 returns them all, unpaged
+	uint32_t cursor;	// next_cursor of the previous page; overrides offset when nonzero
+	uint32_t flags;		// REQUEST_* bits
 	unsigned int check;				// check sum
 };
+
+// Args of a request on a v1 connection: args and the paging fields after it
+#define REQUEST_V1_ARGS 256
+
+// Request flag: send the answer as a stream of pages (see struct request_msg)
+#define REQUEST_STREAM 0x01
+
+// Every request flag this build knows; a request with any other is refused
+#define REQUEST_FLAGS REQUEST_STREAM
+
+// Primary results per page of a stream, offset or cursor that does not set a limit
+#define DEFAULT_PAGE_RESULTS 128
 struct response_header{
 	enum status_code status; // Status code (enum: OK, ERROR)	
 	int num_tracks; // Number of tracks in the data block
@@ -63,6 +109,16 @@ struct response_data {
 	struct album *albums; // Array of Album structures (dynamically allocated)
 	struct playlist *playlists; // Array of Playlist structures (dynamically allocated)
 };
+/**
+ * @brief Follows the records of an OK answer to a paged request on the wire.
+ * It is not part of the v1 check sum, which still covers the header and the
+ * records alone.
+ */
+struct response_page {
+	uint32_t total;			// primary results over all pages
+	uint32_t first;			// position of this page's first primary result
+	uint32_t next_cursor;	// cursor of the next page (its first position + 1); 0 after the last one
+};
 struct response_msg {
 	struct response_header header; // Response header block
 	// Union of response data and error message (they share the same memory)
@@ -71,6 +127,8 @@ struct response_msg {
 		struct response_data data; // Response data block
 		char error_message[256]; // Error message string
     };	
+	int paged;					// answers a paged request, so page is sent too
+	struct response_page page;
 };
 
 /**
@@ -143,6 +201,46 @@ parse_line (char *line,
 	struct album *a, 
 	struct playlist *pl);
 
+/**
+ * @brief convert a "YYYY-MM-DD" date (or a bare year) to local Linux time
+ */
+time_t string_to_linux_time(const char* date_string);
+
+/**
+ * @brief atof() without the slow path for the plain decimals the CSV holds:
+ * [sign]digits[.digits][e[sign]digits] whose digits fit in 53 bits, scaled by
+ * at most 10^22, takes one multiply or divide of exact doubles, so it rounds
+ * once, to the same double atof() gives. Anything else goes to atof().
+ */
+double parse_double(const char *s);
+
+/**
+ * @brief atoi() for [sign]digits (anything else goes to atoi()).
+ */
+int parse_int(const char *s);
+
+// Slots in a date_cache (a power of two); dates longer than the key are not cached
+#define DATE_CACHE_SLOTS 1024
+#define DATE_CACHE_KEY 16
+
+/**
+ * @brief Direct-mapped memo of string_to_linux_time(), keyed by the date
+ * string. Albums share a few thousand release dates, so nearly every lookup
+ * skips sscanf() and mktime(). Zero it before first use; it is not locked,
+ * so each thread needs its own.
+ */
+struct date_cache {
+    struct {
+        char date[DATE_CACHE_KEY];      // "" for an empty slot
+        time_t when;
+    } slots[DATE_CACHE_SLOTS];
+};
+
+/**
+ * @brief string_to_linux_time(date), from the cache when date was seen before.
+ */
+time_t date_cache_lookup(struct date_cache *cache, const char *date);
+
 char* strtok_quotes(char *str, const char *delim);
 
 char* clean_str(char *token);
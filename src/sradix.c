@@ -0,0 +1,72 @@
+/**
+ * @file sradix.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief LSD radix sort for 64-bit index pairs.
+ * @version 0.1
+ * @date 2025-04-09
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "sradix.h"
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1u << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+int radix_sort_u64(uint64_t *values, size_t n, unsigned first_byte) {
+    if (n < 2 || first_byte >= RADIX_PASSES) {
+        return 0;
+    }
+
+    uint64_t *tmp = (uint64_t *)malloc(n * sizeof(uint64_t));
+    size_t (*counts)[RADIX_SIZE] = calloc(RADIX_PASSES, sizeof(*counts));
+    if (!tmp || !counts) {
+        free(tmp);
+        free(counts);
+        return -1;
+    }
+
+    // One read of the input builds the histogram of every byte
+    for (size_t i = 0; i < n; i++) {
+        uint64_t v = values[i];
+        for (unsigned b = first_byte; b < RADIX_PASSES; b++) {
+            counts[b][(v >> (b * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+
+    uint64_t *src = values, *dst = tmp;
+    for (unsigned b = first_byte; b < RADIX_PASSES; b++) {
+        unsigned shift = b * RADIX_BITS;
+
+        // A byte shared by every value would leave the order as it is
+        if (counts[b][(src[0] >> shift) & (RADIX_SIZE - 1)] == n) {
+            continue;
+        }
+
+        // Turn the counts into starting positions, then scatter
+        size_t pos = 0;
+        for (unsigned d = 0; d < RADIX_SIZE; d++) {
+            size_t c = counts[b][d];
+            counts[b][d] = pos;
+            pos += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            dst[counts[b][(src[i] >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+        }
+
+        uint64_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != values) {
+        memcpy(values, src, n * sizeof(uint64_t));
+    }
+    free(tmp);
+    free(counts);
+    return 0;
+}
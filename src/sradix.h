@@ -0,0 +1,29 @@
+#ifndef SRADIX_H
+#define SRADIX_H
+
+/**
+ * @file sradix.h
+ * @brief LSD radix sort for the 64-bit (key << 32 | member) pairs used to build indexes.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-04-09
+ *
+ * Index builders pack each relation entry into one uint64_t so that a plain
+ * integer sort groups it by key (and, within a key, by member). Sorting one
+ * byte at a time costs a fixed number of linear passes, where qsort() pays
+ * a function call per comparison and O(n log n) of them.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Sort n values ascending by their bytes first_byte..7 (byte 0 is the
+ * least significant). The sort is stable, so values that tie on those bytes
+ * keep their input order: first_byte 4 sorts pairs by key alone.
+ * Passes over a byte that is the same in every value are skipped.
+ *
+ * @return int 0, or -1 if out of memory (values left unsorted)
+ */
+int radix_sort_u64(uint64_t *values, size_t n, unsigned first_byte);
+
+#endif // SRADIX_H
@@ -0,0 +1,182 @@
+/**
+ * @file sscan.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Structural index of a CSV buffer: where its fields end.
+ * @version 0.1
+ * @date 2025-04-18
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#include "sscan.h"
+
+// Bytes classified per step, one bit each
+#define SCAN_BLOCK 64
+
+/**
+ * @brief Where each kind of structural byte sits in one block (bit i is byte i).
+ */
+struct scan_masks {
+    uint64_t commas;
+    uint64_t quotes;
+    uint64_t newlines;
+};
+
+/**
+ * @brief Bit i of the result is the XOR of bits 0..i: set from an opening
+ * quote up to, not including, its closing one.
+ */
+static inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/**
+ * @brief Append the separators of one classified block at offset base.
+ * in_quotes carries whether the block starts (and then ends) inside quotes.
+ */
+static inline size_t emit_block(const struct scan_masks *m, uint32_t base, uint64_t *in_quotes,
+                                uint32_t *seps, size_t n) {
+    uint64_t quoted = prefix_xor(m->quotes) ^ (0 - *in_quotes);
+    *in_quotes = quoted >> 63;
+    uint64_t found = (m->commas | m->newlines) & ~quoted;
+    while (found) {
+        seps[n++] = base + (uint32_t)__builtin_ctzll(found);
+        found &= found - 1;
+    }
+    return n;
+}
+
+static void classify_scalar(const char *p, struct scan_masks *m) {
+    m->commas = m->quotes = m->newlines = 0;
+    for (int i = 0; i < SCAN_BLOCK; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (p[i]) {
+        case ',':  m->commas |= bit; break;
+        case '"':  m->quotes |= bit; break;
+        case '\n': m->newlines |= bit; break;
+        }
+    }
+}
+
+static size_t scan_scalar(const char *p, size_t len, uint32_t *seps, uint64_t *in_quotes) {
+    size_t n = 0;
+    struct scan_masks m;
+    for (size_t i = 0; i + SCAN_BLOCK <= len; i += SCAN_BLOCK) {
+        classify_scalar(p + i, &m);
+        n = emit_block(&m, (uint32_t)i, in_quotes, seps, n);
+    }
+    return n;
+}
+
+#ifdef SCAN_X86
+static void classify_sse2(const char *p, struct scan_masks *m) {
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i newline = _mm_set1_epi8('\n');
+    m->commas = m->quotes = m->newlines = 0;
+    for (int i = 0; i < SCAN_BLOCK; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        m->commas |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)) << i;
+        m->quotes |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << i;
+        m->newlines |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) << i;
+    }
+}
+
+static size_t scan_sse2(const char *p, size_t len, uint32_t *seps, uint64_t *in_quotes) {
+    size_t n = 0;
+    struct scan_masks m;
+    for (size_t i = 0; i + SCAN_BLOCK <= len; i += SCAN_BLOCK) {
+        classify_sse2(p + i, &m);
+        n = emit_block(&m, (uint32_t)i, in_quotes, seps, n);
+    }
+    return n;
+}
+
+__attribute__((target("avx2")))
+static inline void classify_avx2(const char *p, struct scan_masks *m) {
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+    m->commas = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, comma))
+        | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, comma)) << 32;
+    m->quotes = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, quote))
+        | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, quote)) << 32;
+    m->newlines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline))
+        | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline)) << 32;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *p, size_t len, uint32_t *seps, uint64_t *in_quotes) {
+    size_t n = 0;
+    struct scan_masks m;
+    for (size_t i = 0; i + SCAN_BLOCK <= len; i += SCAN_BLOCK) {
+        classify_avx2(p + i, &m);
+        n = emit_block(&m, (uint32_t)i, in_quotes, seps, n);
+    }
+    return n;
+}
+#endif
+
+int scan_supported(enum scan_impl impl) {
+    switch (impl) {
+    case SCAN_AUTO:
+    case SCAN_SCALAR:
+        return 1;
+#ifdef SCAN_X86
+    case SCAN_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SCAN_AVX2:
+        return __builtin_cpu_supports("avx2");
+#else
+    default:
+        return 0;
+#endif
+    }
+    return 0;
+}
+
+size_t csv_scan(const char *p, size_t len, uint32_t *seps, enum scan_impl impl) {
+    if (!scan_supported(impl)) {
+        impl = SCAN_AUTO;
+    }
+    if (impl == SCAN_AUTO) {
+        impl = scan_supported(SCAN_AVX2) ? SCAN_AVX2 : scan_supported(SCAN_SSE2) ? SCAN_SSE2 : SCAN_SCALAR;
+    }
+
+    // Whole blocks straight from the buffer...
+    uint64_t in_quotes = 0;
+    size_t n;
+    switch (impl) {
+#ifdef SCAN_X86
+    case SCAN_AVX2: n = scan_avx2(p, len, seps, &in_quotes); break;
+    case SCAN_SSE2: n = scan_sse2(p, len, seps, &in_quotes); break;
+#endif
+    default:        n = scan_scalar(p, len, seps, &in_quotes); break;
+    }
+
+    // ...and the tail from a zero-padded copy, so no load reads past the end
+    size_t done = len - len % SCAN_BLOCK;
+    if (done < len) {
+        char tail[SCAN_BLOCK] = {0};
+        struct scan_masks m;
+        memcpy(tail, p + done, len - done);
+        classify_scalar(tail, &m);
+        n = emit_block(&m, (uint32_t)done, &in_quotes, seps, n);
+    }
+    return n;
+}
@@ -0,0 +1,45 @@
+#ifndef SSCAN_H
+#define SSCAN_H
+
+/**
+ * @file sscan.h
+ * @brief Structural index of a CSV buffer: where its fields end.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-04-18
+ *
+ * The buffer is classified 64 bytes at a time into bitmasks of its commas,
+ * quotes and newlines (with AVX2 or SSE2 compares when the CPU has them, one
+ * byte at a time otherwise). A prefix XOR over the quote mask marks the bytes
+ * inside quotes, and the commas and newlines outside them are the field
+ * separators, listed in order. Every quote toggles quoting, which is exactly
+ * RFC 4180 for well-formed input: "" inside a quoted field closes and reopens
+ * it with nothing in between.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Which classifier csv_scan() uses
+enum scan_impl {
+    SCAN_AUTO,          // the widest one this CPU supports
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+};
+
+/**
+ * @brief Whether impl can run here (SCAN_AUTO and SCAN_SCALAR always can).
+ */
+int scan_supported(enum scan_impl impl);
+
+/**
+ * @brief Find the ',' and '\n' bytes of p[0 .. len) that are outside quotes,
+ * p[0] being outside quotes. Their offsets from p go to seps, in order, which
+ * must have room for len of them (len itself must fit in a uint32_t).
+ *
+ * @param impl classifier to use; one the CPU lacks falls back to SCAN_AUTO
+ * @return size_t number of separators found
+ */
+size_t csv_scan(const char *p, size_t len, uint32_t *seps, enum scan_impl impl);
+
+#endif // SSCAN_H
@@ -3,7 +3,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 
@@ -12,53 +14,50 @@
 #include "htable.h"
 #include "spotify.h"
 #include "snode.h"
+#include "scatalog.h"
+#include "scsv.h"
+#include "ssnapshot.h"
+#include "sepoch.h"
+#include "sconn.h"
+#include "scache.h"
+#include "sevent.h"
+#include "suring.h"
 
 #include <signal.h>
 #include <ctype.h>  // for isdigit
 #include <stdbool.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+// Upper bound for --workers
+#define MAX_WORKERS 256
+
+// More plays than one request's args can hold (each takes at least 6 bytes)
+#define INSERT_MAX_PLAYS 64
+
+// Default for --cache-bytes
+#define RESPONSE_CACHE_BYTES (64u * 1024 * 1024)
+
+// Longest response cache key: the numbers, the separators and the args
+#define CACHE_KEY_SIZE (REQUEST_V1_ARGS + 64)
+
+_Static_assert(offsetof(struct request_msg, check) - offsetof(struct request_msg, args) == REQUEST_V1_ARGS,
+               "v1 args must run from args up to the check sum");
 
 // TODO: Fix this when have time
 // Ensuring graceful shutdown
 volatile sig_atomic_t keep_running = 1;  // Global flag to control loop exit
+int wake_fd = -1;   // eventfd that kicks every event loop out of epoll_wait
+
+// Held by whichever thread (reloader or ingest) is replacing the catalog
+static pthread_mutex_t publish_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void handle_sigint(int sig) {
     (void)sig;
     printf("\nSIGINT received! Exiting loop...\n");
     keep_running = 0;  // Change flag to break out of loop
-}
-
-bool is_all_digits(const char *s) {
-    if (s == NULL || *s == '\0') {
-        // Empty string or NULL is usually not valid for conversion
-        return false;
-    }
-
-    while (*s) {
-        if (!isdigit((unsigned char)*s)) {
-            return false;
-        }
-        s++;
-    }
-    return true;
-}
-
-void free_resp(struct response_msg *resp) {
-	// This makes sure if resp is not available then we return
-	// We also return if there is an error message (thus no data)
-    if (!resp || resp->error_message) return;
-
-	// Go through all of the data and check whether they exist (not NULL), then free
-    if (resp->data.tracks) {
-        free(resp->data.tracks);
-        resp->data.tracks = NULL;
-    }
-    if (resp->data.albums) {
-        free(resp->data.albums);
-        resp->data.albums = NULL;
-    }
-    if (resp->data.playlists) {
-        free(resp->data.playlists);
-        resp->data.playlists = NULL;
+    if (wake_fd >= 0) {
+        eventfd_write(wake_fd, 1);
     }
 }
 
@@ -81,6 +80,9 @@ void construct_err_response(struct response_msg *resp, enum error_type err) {
     } else if (err == ZERO_ARGS_ERR) {
         printf("ERROR: Zero arguments received\n");
         strncpy(resp->error_message, "ERROR: Zero arguments received", sizeof(resp->error_message) - 1);
+    } else if (err == UNKNOWN_ID_ERR) {
+        printf("ERROR: Unknown track, album or playlist ID\n");
+        strncpy(resp->error_message, "ERROR: Unknown track, album or playlist ID", sizeof(resp->error_message) - 1);
     } 
     // TODO: uncomment this for no results err
     // else if (err == NO_RESULTS_ERR) {
@@ -106,200 +108,189 @@ void construct_err_response(struct response_msg *resp, enum error_type err) {
 }
 
 
-void construct_ok_response(struct response_msg *resp, enum command_id cmd, char *args,  
-    struct htable *tracks, struct htable *albums, struct htable *playlists, 
-    struct htable *track_by_album, struct htable *album_by_track, struct htable *album_by_artist, struct htable *track_by_playlist) {
-        resp->header.status = OK;
-        if (cmd == SHOW_TRACKS) {
-            if (!is_all_digits(args)) {
-                construct_err_response(resp, UNKNOWN_ERR);
-                return;
-            }
-
-            // Count number of tracks
-            uint32_t num = atoi(args);
-            if (num > htable_num_elems(tracks)) {
-                num = htable_num_elems(tracks);
-            }
+// Rows merged with cursors on the stack; more than this falls back to malloc
+#define MERGE_STACK_ROWS 64
 
-            // Allocate memory in response
-            resp->data.tracks = (struct track *)malloc(num * sizeof(struct track));
-            
-            struct track **track_array = (struct track **)htable_values(tracks);
-            qsort(track_array, htable_num_elems(tracks), sizeof(struct track *), track_sort);
+/**
+ * @brief Copy the tracks with the given dense IDs into a new array (NULL when n is 0).
+ */
+static struct track *copy_tracks(const struct catalog *cat, const uint32_t *ids, uint32_t n) {
+    if (n == 0) {
+        return NULL;
+    }
+    struct track *out = (struct track *)malloc(n * sizeof(struct track));
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = cat->tracks[ids[i]];
+    }
+    return out;
+}
 
-            for (uint32_t i = 0; i < num; i++) {
-                resp->data.tracks[i] = *(track_array[i]);
-            }
+/**
+ * @brief Copy the albums with the given dense IDs into a new array (NULL when n is 0).
+ */
+static struct album *copy_albums(const struct catalog *cat, const uint32_t *ids, uint32_t n) {
+    if (n == 0) {
+        return NULL;
+    }
+    struct album *out = (struct album *)malloc(n * sizeof(struct album));
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = cat->albums[ids[i]];
+    }
+    return out;
+}
 
-            free(track_array);
+/**
+ * @brief Total number of members in the given rows of a relation.
+ */
+static uint32_t rows_size(const struct csr *rel, const uint32_t *rows, uint32_t n) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t len;
+        csr_row(rel, rows[i], &len);
+        total += len;
+    }
+    return total;
+}
 
-            resp->header.num_tracks = num;
-            resp->header.num_albums = 0;
-            resp->header.num_playlists = 0;
+struct merge_cursor {
+    const uint32_t *next;
+    const uint32_t *end;
+};
+
+static void cursor_sift_down(struct merge_cursor *heap, uint32_t n, uint32_t i) {
+    for (;;) {
+        uint32_t least = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && *heap[l].next < *heap[least].next) least = l;
+        if (r < n && *heap[r].next < *heap[least].next) least = r;
+        if (least == i) return;
+        struct merge_cursor tmp = heap[i];
+        heap[i] = heap[least];
+        heap[least] = tmp;
+        i = least;
+    }
+}
 
-            return;
+/**
+ * @brief Copy members skip .. skip + count - 1 of the given rows, in
+ * ascending dense-ID (so Spotify-ID) order, as records of stride bytes into
+ * out. Every row is already sorted, so this is a k-way merge; repeats across
+ * rows are kept. Skipped members are passed over without being copied.
+ */
+static void merge_rows(const struct csr *rel, const uint32_t *rows, uint32_t n, uint32_t skip, uint32_t count,
+                       const void *records, size_t stride, void *out) {
+    struct merge_cursor stack_heap[MERGE_STACK_ROWS];
+    struct merge_cursor *heap = n <= MERGE_STACK_ROWS ? stack_heap
+                                                      : (struct merge_cursor *)malloc(n * sizeof(struct merge_cursor));
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t row_len;
+        const uint32_t *begin = csr_row(rel, rows[i], &row_len);
+        const uint32_t *end = begin + row_len;
+        if (begin < end) {
+            heap[len].next = begin;
+            heap[len].end = end;
+            len++;
         }
+    }
+    for (uint32_t i = len / 2; i-- > 0; ) {
+        cursor_sift_down(heap, len, i);
+    }
 
-        if (cmd == SHOW_ALBUMS) {
-            if (!is_all_digits(args)) {
-                construct_err_response(resp, UNKNOWN_ERR);
-                return;
-            }
-
-            // Count number of tracks
-            uint32_t num = atoi(args);
-            if (num > htable_num_elems(albums)) {
-                num = htable_num_elems(albums);
-            }
-
-            // Allocate memory in response
-            resp->data.albums = (struct album *)malloc(num * sizeof(struct album));
-
-            struct album **album_array = (struct album **)htable_values(albums);
-            qsort(album_array, htable_num_elems(albums), sizeof(struct album *), album_sort);
-
-            for (uint32_t i = 0; i < num; i++) {
-                resp->data.albums[i] = *(album_array[i]);
-            }
-
-            free(album_array);
-
-            resp->header.num_tracks = 0;
-            resp->header.num_albums = num;
-            resp->header.num_playlists = 0;
-
-            return;
-        
+    char *dst = (char *)out;
+    while (len > 0 && count > 0) {
+        if (skip > 0) {
+            skip--;
+        } else {
+            memcpy(dst, (const char *)records + (size_t)*heap[0].next * stride, stride);
+            dst += stride;
+            count--;
         }
-
-        if (cmd == SHOW_PLAYLISTS) {
-            if (!is_all_digits(args)) {
-                construct_err_response(resp, UNKNOWN_ERR);
-                return;
-            }
-
-            // Count number of tracks
-            uint32_t num = atoi(args);
-            if (num > htable_num_elems(playlists)) {
-                num = htable_num_elems(playlists);
-            }
-
-            // Allocate memory in response
-            resp->data.playlists = (struct playlist *)malloc(num * sizeof(struct playlist));
-
-            struct playlist **playlist_array = (struct playlist **)htable_values(playlists);
-            qsort(playlist_array, htable_num_elems(playlists), sizeof(struct playlist *), playlist_sort);
-
-            for (uint32_t i = 0; i < num; i++) {
-                resp->data.playlists[i] = *(playlist_array[i]);
-            }
-
-            free(playlist_array);
-
-            resp->header.num_tracks = 0;
-            resp->header.num_albums = 0;
-            resp->header.num_playlists = num;
-
-            return;
+        if (++heap[0].next == heap[0].end) {
+            heap[0] = heap[--len];
         }
+        cursor_sift_down(heap, len, 0);
+    }
 
-        if (cmd == SEARCH_TRACKS) {
-            // Create keyword/args
-            strcaps(args);
-
-            // Make array from htable
-            void **arr = htable_values(tracks);
-
-            // Sort arr
-            qsort(arr, htable_num_elems(tracks), sizeof(struct track *), track_sort);
-
-            // Create list and add track ids of tracks that contain keyword
-            struct slist *search_res = slist_create();
-            for (uint32_t i = 0; i < htable_num_elems(tracks); i++) {
-                struct track *candidate = (struct track *)arr[i];
-                char *candidate_keyword = strdup(candidate->name);
-                strcaps(candidate_keyword);
+    if (heap != stack_heap) {
+        free(heap);
+    }
+}
 
-                // Check if args exists in candidate_keyword
-                if (strstr(candidate_keyword, args) != NULL) {
-                    slist_add_back(search_res, candidate->track_id);
-                }
-                free(candidate_keyword);
-            }
+/**
+ * @brief Which primary results a request asks for: all of them, or one page.
+ */
+struct page_request {
+    uint32_t start;                 // first primary result
+    uint32_t limit;                 // 0 for every result, unpaged
+};
+
+/**
+ * @brief Pick the primary results [*begin, *end) of total that the request
+ * asks for, and describe the page in resp when it is paged.
+ */
+static void select_page(struct response_msg *resp, const struct page_request *pr, uint32_t total, uint32_t *begin,
+                        uint32_t *end) {
+    if (pr->limit == 0) {
+        *begin = 0;
+        *end = total;
+        return;
+    }
+    *begin = pr->start < total ? pr->start : total;
+    *end = total - *begin > pr->limit ? *begin + pr->limit : total;
+    resp->paged = 1;
+    resp->page.total = total;
+    resp->page.first = *begin;
+    resp->page.next_cursor = *end < total ? *end + 1 : 0;
+}
 
-            free(arr);
+/**
+ * @brief Dense IDs of the records a SEARCH command matches, in ID order (the
+ * caller frees them). args is uppercased in place.
+ */
+static uint32_t *search_hits(enum command_id cmd, char *args, const struct catalog *cat, uint32_t *num_hits) {
+    strcaps(args);
+    const struct trigram_index *index = cmd == SEARCH_TRACKS    ? cat->track_names
+                                        : cmd == SEARCH_ALBUMS  ? cat->album_names
+                                        : cmd == SEARCH_ARTISTS ? cat->artist_names
+                                                                : cat->playlist_names;
+    return trigram_index_search(index, args, num_hits);
+}
 
-            // Add search_res into resp
-            uint32_t matched_count = slist_num_elems(search_res);
+/**
+ * @brief Build the answer to a SEARCH command from its matches (see
+ * search_hits()). Only the requested page is copied.
+ */
+static void construct_search_response(struct response_msg *resp, enum command_id cmd, const uint32_t *hits,
+                                      uint32_t num_hits, const struct page_request *pr, const struct catalog *cat) {
+        resp->header.status = OK;
+        uint32_t begin, end;
+        if (cmd == SEARCH_TRACKS) {
+            // hits: dense IDs of the tracks that contain keyword (in ID order)
             // TODO: uncomment for no results err
-            // if (matched_count == 0) {
-            //     slist_destroy(search_res, 0);
+            // if (num_hits == 0) {
             //     construct_err_response(resp, NO_RESULTS_ERR);
             //     return;
             // }
-            resp->header.num_tracks = (int)matched_count;
-
-
-            if (matched_count > 0) {
-                resp->data.tracks = malloc(matched_count * sizeof(struct track));
-            } else {
-                resp->data.tracks = NULL;
-            }
-
-            int total_albums = 0;
-
-            // Just walk the search_res list and sum up the album list lengths
-            for (struct snode *node = search_res->front; node != NULL; node = node->next) {
-                char *track_id = (char *)node->data;
-                struct slist *album_list = (struct slist *)htable_find(album_by_track, track_id);
-                if (album_list) {
-                    total_albums += slist_num_elems(album_list);
-                }
-            }
-
+            select_page(resp, pr, num_hits, &begin, &end);
+            const uint32_t *page = hits + begin;
+            uint32_t page_count = end - begin;
+            resp->header.num_tracks = (int)page_count;
+
+            // Each track is followed by every album it appears on
+            const struct csr *rel = &cat->track_albums;
+            uint32_t total_albums = rows_size(rel, page, page_count);
             resp->header.num_albums = total_albums;
-            if (total_albums > 0) {
-                resp->data.albums = malloc(total_albums * sizeof(struct album));
-            } else {
-                resp->data.albums = NULL;
-            }
 
-            // Fill response (second pass)
-            uint32_t track_index = 0;
+            resp->data.tracks = copy_tracks(cat, page, page_count);
+            resp->data.albums = total_albums > 0 ? malloc(total_albums * sizeof(struct album)) : NULL;
             uint32_t album_index = 0;
-            for (struct snode *node = search_res->front; node != NULL; node = node->next) {
-                char *track_id = (char *)node->data;
-                // Find the track by ID
-                struct track *track_ptr = (struct track *)htable_find(tracks, track_id);
-                if (!track_ptr) {
-                    continue;
-                }
-
-                // Shallow-copy the track into the response
-                resp->data.tracks[track_index++] = *track_ptr;
-
-                // Now find all the albums for this track
-                struct slist *album_list = (struct slist *)htable_find(album_by_track, track_id);
-                if (!album_list) {
-                    // No albums for this track
-                    continue;
-                }
-
-                // Copy each album into resp->data.albums
-                struct snode *a = album_list->front;
-                while (a) {
-                    char *album_id = (char *)a->data;
-                    struct album *album_ptr = (struct album *)htable_find(albums, album_id);
-                    if (album_ptr) {
-                        resp->data.albums[album_index++] = *album_ptr;
-                    }
-                    a = a->next;
+            for (uint32_t i = 0; i < page_count; i++) {
+                uint32_t len;
+                const uint32_t *albums = csr_row(rel, page[i], &len);
+                for (uint32_t j = 0; j < len; j++) {
+                    resp->data.albums[album_index++] = cat->albums[albums[j]];
                 }
             }
-            
-            // Clean up the search_res list
-            slist_destroy(search_res, 0);
 
             // Fill other header fields as needed
             resp->header.num_playlists = 0;  // or set appropriately if needed
@@ -309,401 +300,833 @@ void construct_ok_response(struct response_msg *resp, enum command_id cmd, char
         }
 
         if (cmd == SEARCH_ALBUMS) {
-            // Uppercase the search keyword in 'keyword'
-            strcaps(args);
-
-            // Build a sorted array of all album pointers
-            void **arr = htable_values(albums);
-            qsort(arr, htable_num_elems(albums), sizeof(struct album *), album_sort);
-
-            // Collect the IDs of all albums whose names contain 'keyword'
-            struct slist *search_res = slist_create();
-            for (uint32_t i = 0; i < htable_num_elems(albums); i++) {
-                struct album *candidate = (struct album *)arr[i];
+            // hits: dense IDs of all albums whose names contain 'keyword' (in ID order)
+            // TODO: uncomment for no results err
+            // if (num_hits == 0) {
+            //     construct_err_response(resp, NO_RESULTS_ERR);
+            //     return;
+            // }
+            select_page(resp, pr, num_hits, &begin, &end);
+            const uint32_t *page = hits + begin;
+            uint32_t page_count = end - begin;
+            resp->header.num_albums = page_count;
+            resp->data.albums = copy_albums(cat, page, page_count);
+
+            // Every track of the albums on this page, sorted overall
+            uint32_t total_tracks = rows_size(&cat->album_tracks, page, page_count);
+            resp->header.num_tracks = total_tracks;
+            resp->data.tracks = total_tracks > 0 ? malloc(total_tracks * sizeof(struct track)) : NULL;
+            merge_rows(&cat->album_tracks, page, page_count, 0, total_tracks, cat->tracks, sizeof(struct track),
+                       resp->data.tracks);
 
-                // Make an uppercase copy of the album's name for case-insensitive search
-                char *candidate_keyword = strdup(candidate->name);
-                strcaps(candidate_keyword);
+            // If have playlists or other fields, set them or set them to zero
+            resp->header.num_playlists = 0; // or a real value if you need
 
-                if (strstr(candidate_keyword, args) != NULL) {
-                    // If the album name contains the keyword, store its album_id
-                    slist_add_back(search_res, candidate->album_id);
-                }
-                free(candidate_keyword);
-            }
+            return;
+        }
 
-            free(arr); // Done with the array from htable_values
+        if (cmd == SEARCH_ARTISTS) {
+            // hits: artists that match 'keyword' (the catalog list is sorted and distinct)
 
-            // Now we know how many albums matched
-            uint32_t matched_count = slist_num_elems(search_res);
             // TODO: uncomment for no results err
-            // if (matched_count == 0) {
-            //     slist_destroy(search_res, 0);
+            // if (num_hits == 0) {
             //     construct_err_response(resp, NO_RESULTS_ERR);
             //     return;
             // }
-            resp->header.num_albums = matched_count;
 
-            // Allocate array for matched albums
-            if (matched_count > 0) {
-                resp->data.albums = malloc(matched_count * sizeof(struct album));
-            } else {
-                resp->data.albums = NULL;
-            }
+            // Every album of every matched artist, sorted overall; the albums are what gets paged
+            uint32_t total_albums = rows_size(&cat->artist_albums, hits, num_hits);
+            select_page(resp, pr, total_albums, &begin, &end);
+            resp->header.num_albums = end - begin;
+            resp->data.albums = end > begin ? malloc((end - begin) * sizeof(struct album)) : NULL;
+            merge_rows(&cat->artist_albums, hits, num_hits, begin, end - begin, cat->albums, sizeof(struct album),
+                       resp->data.albums);
 
-            // We'll also need to gather *all tracks* for the matched albums
-            // First pass: count how many tracks total we'll need
-            uint32_t total_tracks = 0;
-
-            // Walk the matched album list and count all the tracks from track_by_album
-            for (struct snode *node = search_res->front; node != NULL; node = node->next) {
-                char *album_id = (char *)node->data;
-                // Find the list of track IDs associated with this album
-                struct slist *track_list = (struct slist *)htable_find(track_by_album, album_id);
-                if (track_list) {
-                    total_tracks += slist_num_elems(track_list);
-                }
-            }
+            resp->header.num_tracks = 0;       // No tracks in this response
+            resp->header.num_playlists = 0;    // No playlists in this response
 
-            // Allocate array for those tracks
-            resp->header.num_tracks = total_tracks;
-            if (total_tracks > 0) {
-                resp->data.tracks = malloc(total_tracks * sizeof(struct track));
-            } else {
-                resp->data.tracks = NULL;
+            return;
+        }
+
+        if (cmd == SEARCH_PLAYLISTS) {
+            // hits: dense IDs of all playlists whose names contain 'keyword' (in ID order)
+            if (num_hits == 0) {
+                construct_err_response(resp, NO_RESULTS_ERR);
+                return;
             }
+            select_page(resp, pr, num_hits, &begin, &end);
+            const uint32_t *page = hits + begin;
+            uint32_t page_count = end - begin;
+            resp->header.num_playlists = page_count;
+            resp->data.playlists = page_count > 0 ? (struct playlist *)malloc(page_count * sizeof(struct playlist))
+                                                  : NULL;
+
+            // We also need to gather all tracks for the playlists on this page.
+            //    First pass: count total needed.
+            const struct csr *rel = &cat->playlist_tracks;
+            uint32_t total_tracks = rows_size(rel, page, page_count);
+            resp->header.num_tracks = total_tracks;
+            resp->data.tracks = total_tracks > 0 ? malloc(total_tracks * sizeof(struct track)) : NULL;
 
-            // Second pass: fill in albums and tracks
-            uint32_t album_index = 0;
+            // Each playlist's tracks, already sorted by ID within the playlist
             uint32_t track_index = 0;
-            for (struct snode *node = search_res->front; node != NULL; node = node->next) {
-                char *album_id = (char *)node->data;
-                // Find the album in the hashtable
-                struct album *album_ptr = (struct album *)htable_find(albums, album_id);
-                if (!album_ptr) {
-                    // Shouldn't happen if your hashtable is consistent
-                    continue;
+            for (uint32_t i = 0; i < page_count; i++) {
+                resp->data.playlists[i] = cat->playlists[page[i]];
+                uint32_t len;
+                const uint32_t *tracks = csr_row(rel, page[i], &len);
+                for (uint32_t j = 0; j < len; j++) {
+                    resp->data.tracks[track_index++] = cat->tracks[tracks[j]];
                 }
+            }
 
-                // Shallow-copy the album into resp->data.albums
-                resp->data.albums[album_index++] = *album_ptr;
+            // If you have albums, set resp->header.num_albums = 0 or fill accordingly
+            resp->header.num_albums = 0; 
 
-                // Now gather the tracks for this album
-                struct slist *track_list = (struct slist *)htable_find(track_by_album, album_id);
-                if (!track_list) {
-                    // No tracks for this album
-                    continue;
-                }
+            return;
+        }
+    }
 
-                // Use this if want to output sorted tracks for each album (not overall sorted tracks)
-                // Sort the track IDs if you want them in a particular order
-                char **temp = (char **)slist_to_array(track_list);
-                qsort(temp, track_list->counter, sizeof(char *), compare_str_ptr);
-
-                // Copy each track into resp->data.tracks
-                for (uint32_t i = 0; i < track_list->counter; i++) {
-                    char *track_id = temp[i];
-                    struct track *track_ptr = (struct track *)htable_find(tracks, track_id);
-                    if (track_ptr) {
-                        resp->data.tracks[track_index++] = *track_ptr;
-                    }
-                }
-                free(temp);
-            }
+/**
+ * @brief Orders SHOW can list records in, e.g. "show tracks 50 by popularity".
+ * Ties are broken by ID, so every order is total and pages of it line up.
+ */
+enum show_order {
+    ORDER_ID,               // the catalog's own order, so the answer is a slice
+    ORDER_POPULARITY,       // most popular first (tracks)
+    ORDER_NAME,             // by name, in byte order
+    ORDER_RELEASE_DATE,     // newest first (albums)
+    ORDER_DURATION          // longest first (tracks)
+};
+
+// Compares two records for an order; negative when a comes first
+typedef int (*record_cmp)(const void *a, const void *b);
+
+static int track_popularity_cmp(const void *a, const void *b) {
+    int x = ((const struct track *)a)->popularity, y = ((const struct track *)b)->popularity;
+    return (y > x) - (y < x);
+}
 
-            // Sort tracks (overall) -> remove if not want to sort overall (output -> sorted for each album)
-            qsort(resp->data.tracks, total_tracks, sizeof(struct track), track_sort_flat);
+static int track_name_cmp(const void *a, const void *b) {
+    return strcmp(((const struct track *)a)->name, ((const struct track *)b)->name);
+}
 
-            // Clean up the matched album list
-            slist_destroy(search_res, 0);
+static int track_duration_cmp(const void *a, const void *b) {
+    int x = ((const struct track *)a)->duration_ms, y = ((const struct track *)b)->duration_ms;
+    return (y > x) - (y < x);
+}
 
-            // If have playlists or other fields, set them or set them to zero
-            resp->header.num_playlists = 0; // or a real value if you need
+static int album_name_cmp(const void *a, const void *b) {
+    return strcmp(((const struct album *)a)->name, ((const struct album *)b)->name);
+}
 
-            return;
-        }
+static int album_release_date_cmp(const void *a, const void *b) {
+    time_t x = ((const struct album *)a)->release_date, y = ((const struct album *)b)->release_date;
+    return (y > x) - (y < x);
+}
 
-        if (cmd == SEARCH_ARTISTS) {
-            strcaps(args);
+static int playlist_name_cmp(const void *a, const void *b) {
+    return strcmp(((const struct playlist *)a)->name, ((const struct playlist *)b)->name);
+}
 
-            // Build a sorted array of all track pointers (we’ll group by 'artist')
-            uint32_t total_tracks = htable_num_elems(tracks);
-            void **arr = htable_values(tracks);
+/**
+ * @brief The comparison behind an order for the records a SHOW command
+ * lists, or NULL if they cannot be listed in it (ORDER_ID needs none).
+ */
+static record_cmp show_order_cmp(enum command_id cmd, enum show_order order) {
+    switch (order) {
+    case ORDER_POPULARITY:
+        return cmd == SHOW_TRACKS ? track_popularity_cmp : NULL;
+    case ORDER_NAME:
+        return cmd == SHOW_TRACKS ? track_name_cmp : cmd == SHOW_ALBUMS ? album_name_cmp : playlist_name_cmp;
+    case ORDER_RELEASE_DATE:
+        return cmd == SHOW_ALBUMS ? album_release_date_cmp : NULL;
+    case ORDER_DURATION:
+        return cmd == SHOW_TRACKS ? track_duration_cmp : NULL;
+    default:
+        return NULL;
+    }
+}
 
-            // sort
-            qsort(arr, total_tracks, sizeof(struct track *), artist_sort);
+/**
+ * @brief Read SHOW arguments: a count, optionally followed by "by" and an
+ * order (any case). args is left as it is, since a stream reads it again
+ * for every page.
+ *
+ * @return int 0, or -1 if malformed or the order does not apply to cmd
+ */
+static int parse_show_args(enum command_id cmd, const char *args, uint32_t *num, enum show_order *order) {
+    static const struct {
+        const char *name;
+        enum show_order order;
+    } orders[] = {
+        { "id", ORDER_ID },
+        { "popularity", ORDER_POPULARITY },
+        { "name", ORDER_NAME },
+        { "release date", ORDER_RELEASE_DATE },
+        { "duration", ORDER_DURATION },
+    };
+
+    if (!isdigit((unsigned char)*args)) {
+        return -1;
+    }
+    char *end;
+    unsigned long n = strtoul(args, &end, 10);
+    *num = n > UINT32_MAX ? UINT32_MAX : (uint32_t)n;
+    *order = ORDER_ID;
+    while (isspace((unsigned char)*end)) end++;
+    if (*end == '\0') {
+        return 0;
+    }
 
-            // Collect unique artist names that match 'keyword'
-            struct slist *search_res = slist_create();  // will hold unique artist strings
-            for (uint32_t i = 0; i < total_tracks; i++) {
-                struct track *candidate = (struct track *)arr[i];
+    if (strncasecmp(end, "by", 2) != 0 || !isspace((unsigned char)end[2])) {
+        return -1;
+    }
+    end += 3;
+    while (isspace((unsigned char)*end)) end++;
+    for (size_t i = 0; i < sizeof(orders) / sizeof(orders[0]); i++) {
+        if (strcasecmp(end, orders[i].name) == 0) {
+            *order = orders[i].order;
+            return *order == ORDER_ID || show_order_cmp(cmd, *order) ? 0 : -1;
+        }
+    }
+    return -1;
+}
 
-                // Uppercase a copy of candidate->artist
-                char *candidate_keyword = strdup(candidate->artist);
-                strcaps(candidate_keyword);
+/**
+ * @brief True when record a comes before record b (dense IDs into records).
+ */
+static bool record_before(const char *records, size_t stride, record_cmp cmp, uint32_t a, uint32_t b) {
+    int c = cmp(records + (size_t)a * stride, records + (size_t)b * stride);
+    return c < 0 || (c == 0 && a < b);
+}
 
-                // If the artist name contains the keyword, and we haven’t already added them
-                // (slist_find_value(...) checks for duplicates)
-                if (strstr(candidate_keyword, args) != NULL &&
-                    !slist_find_value(search_res, candidate->artist, compare_str)) {
-                    slist_add_back(search_res, candidate->artist);
-                }
-                free(candidate_keyword);
-            }
+static void top_sift_down(uint32_t *heap, uint32_t n, uint32_t i, const char *records, size_t stride,
+                          record_cmp cmp) {
+    for (;;) {
+        uint32_t last = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && record_before(records, stride, cmp, heap[last], heap[l])) last = l;
+        if (r < n && record_before(records, stride, cmp, heap[last], heap[r])) last = r;
+        if (last == i) return;
+        uint32_t tmp = heap[i];
+        heap[i] = heap[last];
+        heap[last] = tmp;
+        i = last;
+    }
+}
 
-            free(arr); // Done with the array from htable_values()
+/**
+ * @brief Dense IDs of the first k of n records in the given order, in that
+ * order (NULL when k is 0, or out of memory). A heap holds the best k seen
+ * so far with the last of them on top, so each record costs one comparison
+ * unless it gets in: O(n log k), and nothing but the k IDs is allocated.
+ */
+static uint32_t *top_records(const void *records, size_t stride, uint32_t n, uint32_t k, record_cmp cmp) {
+    if (k > n) {
+        k = n;
+    }
+    if (k == 0) {
+        return NULL;
+    }
+    uint32_t *heap = (uint32_t *)malloc(k * sizeof(uint32_t));
+    if (!heap) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < k; i++) {
+        heap[i] = i;
+    }
+    for (uint32_t i = k / 2; i-- > 0; ) {
+        top_sift_down(heap, k, i, records, stride, cmp);
+    }
+    for (uint32_t i = k; i < n; i++) {
+        if (record_before(records, stride, cmp, i, heap[0])) {
+            heap[0] = i;
+            top_sift_down(heap, k, 0, records, stride, cmp);
+        }
+    }
 
-            // TODO: uncomment for no results err
-            // if (slist_num_elems(search_res) == 0) {
-            //     slist_destroy(search_res, 0);
-            //     construct_err_response(resp, NO_RESULTS_ERR);
-            //     return;
-            // }
+    // Take the last one off the top until the heap is sorted
+    for (uint32_t len = k; len > 1; len--) {
+        uint32_t tmp = heap[0];
+        heap[0] = heap[len - 1];
+        heap[len - 1] = tmp;
+        top_sift_down(heap, len - 1, 0, records, stride, cmp);
+    }
+    return heap;
+}
 
-            // For each matched artist, we’ll gather all of their albums.
-            //    First, figure out how many total albums we need.
+/**
+ * @brief The catalog slot that keeps the records cmd lists, sorted in order.
+ */
+static unsigned show_order_slot(enum command_id cmd, enum show_order order) {
+    return (unsigned)(cmd - SHOW_TRACKS) * (ORDER_DURATION + 1) + (unsigned)order;
+}
 
-            uint32_t total_albums = 0;
-            for (struct snode *node = search_res->front; node != NULL; node = node->next) {
-                char *artist_name = (char *)node->data;
-                // album_by_artist is presumably: key=artist_name, value=slist of album_ids
-                struct slist *album_list = (struct slist *)htable_find(album_by_artist, artist_name);
-                if (album_list) {
-                    total_albums += slist_num_elems(album_list);
-                }
+/**
+ * @brief Copy the page [begin, end) of the records listed in the given order
+ * into *out (malloc'd, or NULL for an empty page). ID order is how the
+ * catalog is stored, so that page is a slice. For any other order the first
+ * page only needs its end records picked out; a later one (the next page of
+ * a stream or cursor walk) sorts the whole listing once and keeps it in the
+ * catalog, so each page after that is a slice of it too.
+ *
+ * @return int 0, or -1 if out of memory
+ */
+static int copy_show_page(struct catalog *cat, const void *records, size_t stride, uint32_t n,
+                          enum command_id cmd, enum show_order order, uint32_t begin, uint32_t end, void **out) {
+    *out = NULL;
+    if (end == begin) {
+        return 0;
+    }
+    char *page = (char *)malloc((size_t)(end - begin) * stride);
+    if (!page) {
+        return -1;
+    }
+    if (order == ORDER_ID) {
+        memcpy(page, (const char *)records + (size_t)begin * stride, (size_t)(end - begin) * stride);
+    } else {
+        record_cmp cmp = show_order_cmp(cmd, order);
+        unsigned slot = show_order_slot(cmd, order);
+        const uint32_t *sorted = catalog_order(cat, slot);
+        if (!sorted && begin > 0) {
+            uint32_t *all = top_records(records, stride, n, n, cmp);
+            sorted = all ? catalog_keep_order(cat, slot, all) : NULL;
+        }
+        uint32_t *top = NULL;
+        if (!sorted) {
+            top = top_records(records, stride, n, end, cmp);
+            if (!top) {
+                free(page);
+                return -1;
             }
+            sorted = top;
+        }
+        for (uint32_t i = begin; i < end; i++) {
+            memcpy(page + (size_t)(i - begin) * stride, (const char *)records + (size_t)sorted[i] * stride, stride);
+        }
+        free(top);
+    }
+    *out = page;
+    return 0;
+}
 
-            // Fill response header fields
-            resp->header.num_albums = total_albums;
-
-            // Allocate the albums array
-            if (total_albums > 0) {
-                resp->data.albums = malloc(total_albums * sizeof(struct album));
-            } else {
-                resp->data.albums = NULL;
+/**
+ * @brief Build the answer to a SHOW or SEARCH command. Only the requested
+ * page is copied: primary results outside it, and the records joined to
+ * them, are never touched.
+ */
+void construct_ok_response(struct response_msg *resp, enum command_id cmd, char *args, const struct page_request *pr,
+                           struct catalog *cat) {
+        resp->header.status = OK;
+        uint32_t begin, end;
+        if (cmd == SHOW_TRACKS) {
+            uint32_t num;
+            enum show_order order;
+            if (parse_show_args(cmd, args, &num, &order) < 0) {
+                construct_err_response(resp, UNKNOWN_ERR);
+                return;
             }
 
-            // Second pass: copy each matched artist’s albums into resp->data.albums
-            uint32_t album_index = 0;
-            for (struct snode *node = search_res->front; node != NULL; node = node->next) {
-                char *artist_name = (char *)node->data;
-
-                // Get the list of album IDs for this artist
-                struct slist *album_list = (struct slist *)htable_find(album_by_artist, artist_name);
-                if (!album_list) {
-                    // No albums for this artist
-                    continue;
-                }
-
-                // Use this if want to output sorted albums for each artist (not overall sorted albums)
-                // Convert album_list to an array for sorting by album ID 
-                char **temp = (char **)slist_to_array(album_list);
-                qsort(temp, album_list->counter, sizeof(char *), compare_str_ptr);
-
-                // Copy each album struct
-                for (uint32_t i = 0; i < album_list->counter; i++) {
-                    // album_list holds album IDs (char *). We find the actual album struct
-                    struct album *alb_ptr = (struct album *)htable_find(albums, temp[i]);
-                    if (alb_ptr) {
-                        // Shallow copy album into resp->data.albums
-                        resp->data.albums[album_index++] = *alb_ptr;
-                    }
-                }
-                free(temp);
+            // Count number of tracks
+            if (num > cat->num_tracks) {
+                num = cat->num_tracks;
             }
 
-            // Sort albums (overall) -> remove if not want to sort overall (output -> sorted for each artist)
-            qsort(resp->data.albums, total_albums, sizeof(struct album), album_sort_flat);
+            // Copy the requested part of the first num tracks in that order
+            select_page(resp, pr, num, &begin, &end);
+            num = end - begin;
+            void *page;
+            if (copy_show_page(cat, cat->tracks, sizeof(struct track), cat->num_tracks, cmd, order, begin, end,
+                               &page) < 0) {
+                construct_err_response(resp, UNKNOWN_ERR);
+                return;
+            }
+            resp->data.tracks = (struct track *)page;
 
-            // Clean up the slist of artist names
-            slist_destroy(search_res, 0); // we didn’t allocate the artist strings; they’re from your track->artist
+            resp->header.num_tracks = num;
+            resp->header.num_albums = 0;
+            resp->header.num_playlists = 0;
 
-            resp->header.num_tracks = 0;       // No tracks in this response
-            resp->header.num_playlists = 0;    // No playlists in this response
-            
             return;
         }
 
-        if (cmd == SEARCH_PLAYLISTS) {
-            strcaps(args);
-
-            // Build a sorted array of all playlist pointers
-            void **arr = htable_values(playlists);
-            qsort(arr, htable_num_elems(playlists), sizeof(struct playlist *), playlist_sort);
-
-            // Collect the IDs of all playlists whose names contain 'keyword'
-            struct slist *search_res = slist_create();
-            for (uint32_t i = 0; i < htable_num_elems(playlists); i++) {
-                struct playlist *candidate = (struct playlist *)arr[i];
+        if (cmd == SHOW_ALBUMS) {
+            uint32_t num;
+            enum show_order order;
+            if (parse_show_args(cmd, args, &num, &order) < 0) {
+                construct_err_response(resp, UNKNOWN_ERR);
+                return;
+            }
 
-                // Make an uppercase copy of the candidate's name
-                char *candidate_keyword = strdup(candidate->name);
-                strcaps(candidate_keyword);
+            // Count number of albums
+            if (num > cat->num_albums) {
+                num = cat->num_albums;
+            }
 
-                if (strstr(candidate_keyword, args) != NULL) {
-                    // If the playlist name contains the keyword, store its ID
-                    slist_add_back(search_res, candidate->playlist_id);
-                }
-                free(candidate_keyword);
+            // Copy the requested part of the first num albums in that order
+            select_page(resp, pr, num, &begin, &end);
+            num = end - begin;
+            void *page;
+            if (copy_show_page(cat, cat->albums, sizeof(struct album), cat->num_albums, cmd, order, begin, end,
+                               &page) < 0) {
+                construct_err_response(resp, UNKNOWN_ERR);
+                return;
             }
+            resp->data.albums = (struct album *)page;
 
-            free(arr); // Done with the array from htable_values
+            resp->header.num_tracks = 0;
+            resp->header.num_albums = num;
+            resp->header.num_playlists = 0;
 
-            // Number of matched playlists
-            uint32_t matched_count = slist_num_elems(search_res);
-            if (matched_count == 0) {
-                slist_destroy(search_res, 0);
-                construct_err_response(resp, NO_RESULTS_ERR);
+            return;
+        
+        }
+
+        if (cmd == SHOW_PLAYLISTS) {
+            uint32_t num;
+            enum show_order order;
+            if (parse_show_args(cmd, args, &num, &order) < 0) {
+                construct_err_response(resp, UNKNOWN_ERR);
                 return;
             }
-            resp->header.num_playlists = matched_count;
 
-            // Allocate array for these matching playlists
-            if (matched_count > 0) {
-                resp->data.playlists = malloc(matched_count * sizeof(struct playlist));
-            } else {
-                resp->data.playlists = NULL;
+            // Count number of playlists
+            if (num > cat->num_playlists) {
+                num = cat->num_playlists;
             }
 
-            // We also need to gather all tracks for the matched playlists.
-            //    First pass: count total needed.
-            uint32_t total_tracks = 0;
-            for (struct snode *node = search_res->front; node != NULL; node = node->next) {
-                char *playlist_id = (char *)node->data;
-                // Find the list of track IDs associated with this playlist
-                struct slist *track_list = (struct slist *)htable_find(track_by_playlist, playlist_id);
-                if (track_list) {
-                    total_tracks += slist_num_elems(track_list);
-                }
+            // Copy the requested part of the first num playlists in that order
+            select_page(resp, pr, num, &begin, &end);
+            num = end - begin;
+            void *page;
+            if (copy_show_page(cat, cat->playlists, sizeof(struct playlist), cat->num_playlists, cmd, order, begin, end,
+                               &page) < 0) {
+                construct_err_response(resp, UNKNOWN_ERR);
+                return;
             }
+            resp->data.playlists = (struct playlist *)page;
 
-            // Allocate array for those tracks
-            resp->header.num_tracks = total_tracks;
-            if (total_tracks > 0) {
-                resp->data.tracks = malloc(total_tracks * sizeof(struct track));
-            } else {
-                resp->data.tracks = NULL;
-            }
+            resp->header.num_tracks = 0;
+            resp->header.num_albums = 0;
+            resp->header.num_playlists = num;
 
-            // Fill in resp->data.playlists and resp->data.tracks
-            uint32_t playlist_index = 0;
-            uint32_t track_index = 0;
-            for (struct snode *node = search_res->front; node != NULL; node = node->next) {
-                char *playlist_id = (char *)node->data;
-                // Find the playlist in the hashtable
-                struct playlist *playlist_ptr = (struct playlist *)htable_find(playlists, playlist_id);
-                if (!playlist_ptr) {
-                    // Shouldn't happen if hashtable is consistent, but be safe
-                    continue;
-                }
+            return;
+        }
 
-                // Shallow-copy the playlist into resp->data.playlists
-                resp->data.playlists[playlist_index++] = *playlist_ptr;
+        // A search: find the matches once, then build the page from them
+        uint32_t num_hits;
+        uint32_t *hits = search_hits(cmd, args, cat, &num_hits);
+        construct_search_response(resp, cmd, hits, num_hits, pr, cat);
+        free(hits);
+    }
 
-                // Now gather the tracks for this playlist
-                struct slist *track_list = (struct slist *)htable_find(track_by_playlist, playlist_id);
-                if (!track_list) {
-                    continue;
-                }
+/**
+ * @brief Plays accepted by INSERT_PLAY(S), waiting for the ingest thread to
+ * fold them into the next catalog generation.
+ */
+struct ingest {
+    pthread_t thread;
+    pthread_mutex_t lock;           // guards the queue
+    pthread_cond_t ready;           // signalled when plays are queued, and on exit
+    struct play *pending;
+    size_t num_pending;
+    size_t capacity;
+    struct epoch *catalog;
+};
+
+/**
+ * @brief Queue n plays for the ingest thread.
+ *
+ * @return int 0, or -1 if out of memory
+ */
+static int ingest_push(struct ingest *in, const struct play *plays, size_t n) {
+    pthread_mutex_lock(&in->lock);
+    if (in->num_pending + n > in->capacity) {
+        size_t capacity = in->capacity > 0 ? in->capacity * 2 : 64;
+        while (capacity < in->num_pending + n) capacity *= 2;
+        struct play *grown = (struct play *)realloc(in->pending, capacity * sizeof(struct play));
+        if (!grown) {
+            pthread_mutex_unlock(&in->lock);
+            return -1;
+        }
+        in->pending = grown;
+        in->capacity = capacity;
+    }
+    memcpy(in->pending + in->num_pending, plays, n * sizeof(struct play));
+    in->num_pending += n;
+    pthread_cond_signal(&in->ready);
+    pthread_mutex_unlock(&in->lock);
+    return 0;
+}
 
-                // Sort the track IDs if you want them in a particular order (like compare_str_ptr)
-                char **temp = (char **)slist_to_array(track_list);
-                qsort(temp, track_list->counter, sizeof(char *), compare_str_ptr);
-
-                // Copy each track into resp->data.tracks
-                for (uint32_t i = 0; i < track_list->counter; i++) {
-                    char *track_id = temp[i];
-                    struct track *track_ptr = (struct track *)htable_find(tracks, track_id);
-                    if (track_ptr) {
-                        resp->data.tracks[track_index++] = *track_ptr;
-                    }
-                }
-                free(temp);
+/**
+ * @brief Everything a request handler needs to answer queries. Each worker
+ * has its own, naming its reader slot in the shared catalog epoch.
+ */
+struct server_ctx {
+    struct epoch *catalog;          // publishes the current struct catalog
+    uint32_t reader;
+    struct ingest *ingest;          // where INSERT_PLAY(S) queue their plays
+    struct scache *cache;           // serialized SHOW and SEARCH answers; NULL when disabled
+};
+
+/**
+ * @brief Split INSERT_PLAY(S) arguments into plays: three IDs each (track,
+ * album, playlist) separated by spaces or commas, plays separated by ';'.
+ *
+ * @return int number of plays (0 for empty args), or -1 if malformed or more than max_plays
+ */
+static int parse_plays(char *args, struct play *plays, int max_plays) {
+    int n = 0;
+    char *play_save, *id_save;
+    for (char *play = strtok_r(args, ";", &play_save); play; play = strtok_r(NULL, ";", &play_save)) {
+        char *ids[3];
+        int num_ids = 0;
+        for (char *id = strtok_r(play, " \t,", &id_save); id; id = strtok_r(NULL, " \t,", &id_save)) {
+            if (num_ids == 3 || strlen(id) >= sizeof(plays[n].track_id)) {
+                return -1;
             }
+            ids[num_ids++] = id;
+        }
+        if (num_ids == 0) {
+            continue;   // an empty play, e.g. after a trailing ';'
+        }
+        if (num_ids < 3 || n == max_plays) {
+            return -1;
+        }
+        strcpy(plays[n].track_id, ids[0]);
+        strcpy(plays[n].album_id, ids[1]);
+        strcpy(plays[n].playlist_id, ids[2]);
+        n++;
+    }
+    return n;
+}
 
-            // Clean up
-            slist_destroy(search_res, 0);
+/**
+ * @brief Check the plays of an INSERT_PLAY(S) request against the current
+ * catalog and queue them. The response goes out before the plays are
+ * visible: the ingest thread publishes them with the next generation.
+ */
+static void construct_insert_response(struct response_msg *resp, enum command_id cmd, char *args,
+                                      struct server_ctx *ctx) {
+    struct play plays[INSERT_MAX_PLAYS];
+    int n = parse_plays(args, plays, cmd == INSERT_PLAY ? 1 : INSERT_MAX_PLAYS);
+    if (n <= 0) {
+        construct_err_response(resp, n == 0 ? ZERO_ARGS_ERR : UNKNOWN_ERR);
+        return;
+    }
 
-            // If you have albums, set resp->header.num_albums = 0 or fill accordingly
-            resp->header.num_albums = 0; 
+    // A play can only relate records the catalog has; it carries no names for new ones
+    bool known = true;
+    struct catalog *cat = (struct catalog *)epoch_enter(ctx->catalog, ctx->reader);
+    for (int i = 0; known && i < n; i++) {
+        known = catalog_track_id(cat, plays[i].track_id) != CATALOG_NO_ID &&
+                catalog_album_id(cat, plays[i].album_id) != CATALOG_NO_ID &&
+                catalog_playlist_id(cat, plays[i].playlist_id) != CATALOG_NO_ID;
+    }
+    epoch_exit(ctx->catalog, ctx->reader);
+    if (!known) {
+        construct_err_response(resp, UNKNOWN_ID_ERR);
+        return;
+    }
 
-            return;
-        }
+    if (ingest_push(ctx->ingest, plays, (size_t)n) < 0) {
+        construct_err_response(resp, UNKNOWN_ERR);
+        return;
     }
+    resp->header.status = OK;
+    resp->header.num_tracks = 0;
+    resp->header.num_albums = 0;
+    resp->header.num_playlists = 0;
+}
 
-#include <arpa/inet.h>  // Required for `inet_pton()`
+/**
+ * @brief Fill in the v1 check sum of an OK response (an error's is set when
+ * it is built, and a v2 frame has its own).
+ */
+static void set_v1_check(struct response_msg *resp) {
+    // Compute the checksum exactly as in the demo
+    // Zero out the check field before computing the checksum.
+    resp->header.check = 0;
+    unsigned int checksum = compute_checksum(&resp->header, sizeof(resp->header), 1337);
+    checksum += compute_checksum(resp->data.tracks, resp->header.num_tracks * sizeof(struct track), checksum);
+    checksum += compute_checksum(resp->data.albums, resp->header.num_albums * sizeof(struct album), checksum);
+    checksum += compute_checksum(resp->data.playlists, resp->header.num_playlists * sizeof(struct playlist), checksum);
+    resp->header.check = checksum;
+}
 
-int main(int argc, char *argv[]) {
-    putenv("TZ=US/Eastern");
-	tzset();
-    // Validate arguments
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <FILE_NAME> <PORT>\n", argv[0]);
-        return 1;
+/**
+ * @brief A SHOW or SEARCH answered as a stream of pages. Each page is built
+ * from the current catalog inside its own read section, so a stream never
+ * holds a reload back. The matches of a search are found once and reused for
+ * as long as the catalog they came from is current; after a reload or insert
+ * they are found again and the stream carries on from the same position,
+ * just as a client following cursors would.
+ */
+struct response_stream {
+    struct conn_stream base;
+    struct server_ctx *ctx;
+    enum command_id cmd;
+    char args[sizeof(((struct request_msg *)0)->args)];
+    enum protocol_version encoding;
+    struct page_request page;       // the next page to build
+    uint32_t *hits;                 // matches of a search in catalog generation hits_generation
+    uint32_t num_hits;
+    uint64_t hits_generation;
+};
+
+static bool stream_next(struct conn_stream *base, struct response_msg *resp) {
+    struct response_stream *s = (struct response_stream *)base;
+    struct catalog *cat = (struct catalog *)epoch_enter(s->ctx->catalog, s->ctx->reader);
+    if (s->cmd < SEARCH_TRACKS) {
+        construct_ok_response(resp, s->cmd, s->args, &s->page, cat);
+    } else {
+        if (!s->hits || s->hits_generation != cat->generation) {
+            free(s->hits);
+            s->hits = search_hits(s->cmd, s->args, cat, &s->num_hits);
+            s->hits_generation = cat->generation;
+        }
+        construct_search_response(resp, s->cmd, s->hits, s->num_hits, &s->page, cat);
     }
+    epoch_exit(s->ctx->catalog, s->ctx->reader);
 
-    // Convert port argument to integer
-    int port = atoi(argv[2]);
-    if (port <= 0 || port > 65535) {
-        fprintf(stderr, "Invalid port number: %s\n", argv[2]);
-        return 1;
+    if (resp->header.status == OK && s->encoding == PROTOCOL_V1) {
+        set_v1_check(resp);
+    }
+    if (resp->header.status != OK || resp->page.next_cursor == 0) {
+        return false;
     }
+    s->page.start = resp->page.next_cursor - 1;
+    return true;
+}
 
-    // SET UP DATA ==========================================================================================
-    FILE *file;
-    file = fopen(argv[1], "r");
-    if (file == NULL) {
-        perror("Error opening file");
-        return 2;
+static void stream_destroy(struct conn_stream *base) {
+    struct response_stream *s = (struct response_stream *)base;
+    free(s->hits);
+    free(s);
+}
+
+/**
+ * @brief Build the first page of a streamed answer into resp.
+ *
+ * @return struct conn_stream* what builds the pages after it, or NULL if
+ * there are none (or no memory to stream with: resp is then an error)
+ */
+static struct conn_stream *start_stream(struct response_msg *resp, enum command_id cmd, const char *args,
+                                        const struct page_request *page, enum protocol_version encoding,
+                                        struct server_ctx *ctx) {
+    struct response_stream *s = (struct response_stream *)calloc(1, sizeof(struct response_stream));
+    if (!s) {
+        construct_err_response(resp, UNKNOWN_ERR);
+        return NULL;
     }
+    s->base.next = stream_next;
+    s->base.destroy = stream_destroy;
+    s->ctx = ctx;
+    s->cmd = cmd;
+    memcpy(s->args, args, sizeof(s->args));
+    s->encoding = encoding;
+    s->page.start = page->start;
+    s->page.limit = page->limit > 0 ? page->limit : DEFAULT_PAGE_RESULTS;
+    if (!stream_next(&s->base, resp)) {
+        stream_destroy(&s->base);
+        return NULL;
+    }
+    return &s->base;
+}
 
-    // Create the data structures
-    struct slist *plays = slist_create();
-    struct htable *tracks = htable_create(1024);
-    struct htable *albums = htable_create(1024);
-    struct htable *playlists = htable_create(128);
-    if (!plays || !tracks || !albums || !playlists) {
-        perror("Error creating data.");
-        return 3;
+/**
+ * @brief Name the answer to a SHOW or SEARCH request in the response cache.
+ * Requests that must get the same bytes get the same key: a search is case
+ * blind, and a count past the end of the catalog lists all of it.
+ *
+ * @return int 0, or -1 if the request is malformed (its error is not cached)
+ */
+static int response_cache_key(enum command_id cmd, const char *args, const struct page_request *pr,
+                              enum protocol_version encoding, const struct catalog *cat, char *key) {
+    uint32_t start = pr->limit > 0 ? pr->start : 0;
+    if (cmd >= SEARCH_TRACKS) {
+        int n = snprintf(key, CACHE_KEY_SIZE, "%d %d %u %u ", cmd, encoding, start, pr->limit);
+        strcaps(strcpy(key + n, args));
+        return 0;
     }
 
-    // Read data from the file
-    read_csv_to_lists(file, plays, tracks, albums, playlists);
-    fclose(file);
+    uint32_t num;
+    enum show_order order;
+    if (parse_show_args(cmd, args, &num, &order) < 0) {
+        return -1;
+    }
+    uint32_t have = cmd == SHOW_TRACKS ? cat->num_tracks : cmd == SHOW_ALBUMS ? cat->num_albums : cat->num_playlists;
+    snprintf(key, CACHE_KEY_SIZE, "%d %d %u %u %u %d", cmd, encoding, start, pr->limit, num < have ? num : have,
+             order);
+    return 0;
+}
 
-    // Create lookup tables
-    struct htable *track_by_album = create_track_by_album(plays);
-    struct htable *album_by_track = create_album_by_track(plays);
-    struct htable *album_by_artist = create_album_by_artist(plays, tracks);
-    struct htable *track_by_playlist = create_track_by_playlist(plays);
+/**
+ * @brief Answer a SHOW or SEARCH request from the response cache, building
+ * and caching the answer on a miss. A hit sends the bytes as they were cached
+ * and costs no copy or check sum at all. The key carries the catalog
+ * generation, so an answer is never sent once a reload or insert has
+ * replaced the catalog it came from.
+ *
+ * @return struct scache_entry* the answer (resp is left empty), or NULL if it
+ * is not cacheable: resp then holds it, unchecked
+ */
+static struct scache_entry *construct_cached_response(struct response_msg *resp, enum command_id cmd, char *args,
+                                                      const struct page_request *pr, enum protocol_version encoding,
+                                                      struct server_ctx *ctx) {
+    char key[CACHE_KEY_SIZE];
+    struct catalog *cat = (struct catalog *)epoch_enter(ctx->catalog, ctx->reader);
+    uint64_t generation = cat->generation;
+    if (response_cache_key(cmd, args, pr, encoding, cat, key) < 0) {
+        construct_ok_response(resp, cmd, args, pr, cat);
+        epoch_exit(ctx->catalog, ctx->reader);
+        return NULL;
+    }
+    struct scache_entry *hit = scache_get(ctx->cache, key, generation);
+    if (!hit) {
+        construct_ok_response(resp, cmd, args, pr, cat);
+    }
+    epoch_exit(ctx->catalog, ctx->reader);
+    if (hit || resp->header.status != OK) {
+        return hit;
+    }
 
-    if (!track_by_album || !track_by_playlist || !album_by_track || !album_by_artist) {
-        perror("Error creating lookup tables.");
-        return 1;
+    if (encoding == PROTOCOL_V1) {
+        set_v1_check(resp);
     }
+    size_t len;
+    unsigned char *bytes = resp_serialize(resp, encoding, &len);
+    struct scache_entry *e = bytes ? scache_put(ctx->cache, key, generation, bytes, len) : NULL;
+    if (e) {
+        free_resp(resp);
+    }
+    return e;
+}
 
+/**
+ * @brief Validate one request and build its response (called by the event loop).
+ */
+enum conn_action handle_request(struct request_msg *request, struct response_msg *resp,
+                                enum protocol_version *protocol, struct conn_stream **stream,
+                                struct scache_entry **cached, void *arg) {
+    struct server_ctx *ctx = (struct server_ctx *)arg;
+    enum protocol_version encoding = *protocol;    // of this response
     enum command_id local_cmd;
-    char local_args[256] = {0};
+    char local_args[REQUEST_V1_ARGS] = {0};
+
+    // Checksum check (before clean_str, which edits the args in place)
+    struct request_msg temp = *request;
+    temp.check = 0;  // Zero out the checksum field before computing
+    unsigned int check = compute_checksum(&temp, sizeof(temp), 7331);
+
+    // Copy over command and args to parse
+    local_cmd = request->command;
+    struct page_request page = {0, 0};
+    uint32_t flags = 0;
+    // A v1 client may not know the paging fields, so to it they are more args
+    char *args = (char *)request + offsetof(struct request_msg, args);
+    size_t args_size = REQUEST_V1_ARGS;
+    if (encoding == PROTOCOL_V2) {
+        page.start = request->cursor > 0 ? request->cursor - 1 : request->offset;
+        page.limit = request->limit;
+        if (page.limit == 0 && (request->cursor > 0 || request->offset > 0)) {
+            // Asking for a place in the result only makes sense for a page
+            page.limit = DEFAULT_PAGE_RESULTS;
+        }
+        flags = request->flags;
+        args_size = sizeof(request->args);
+    }
+    args[args_size - 1] = '\0';  // Never trust the client to terminate
+    strncpy(local_args, clean_str(args), sizeof(local_args) - 1);
+    local_args[sizeof(local_args) - 1] = '\0';  // Ensure null termination
+
+    if (check != request->check) {
+        construct_err_response(resp, CHECK_SUM_ERR);
+    }
 
-    // SET UP SERVER SOCKET ================================================================================
-    int server_fd, new_socket;
+    // Validate command
+    else if (local_cmd < SHOW_TRACKS || local_cmd > SET_PROTOCOL) {
+        construct_err_response(resp, INVALID_CMD_ERR);
+    }
+
+    // A flag this build does not know would change the answer in a way it cannot give
+    else if (flags & ~REQUEST_FLAGS) {
+        construct_err_response(resp, INVALID_CMD_ERR);
+    }
+
+    // TODO: Fix this later
+    // Check if args are empty
+    // else if (strlen(local_args) == 0) {
+    //     construct_err_response(resp, ZERO_ARGS_ERR);
+    // }
+
+    // Handle QUIT command
+    else if (local_cmd == QUIT) {
+        return CONN_SHUTDOWN;
+    } else if (SHOW_TRACKS <= local_cmd && local_cmd < QUIT && (flags & REQUEST_STREAM)) {
+        // Each page checks itself, so the stream returns without the check below
+        *stream = start_stream(resp, local_cmd, local_args, &page, encoding, ctx);
+        return CONN_RESPOND;
+    } else if (SHOW_TRACKS <= local_cmd && local_cmd < QUIT && ctx->cache) {
+        // Sent as cached bytes when it can be; otherwise resp holds the answer, to be checked below
+        *cached = construct_cached_response(resp, local_cmd, local_args, &page, encoding, ctx);
+        if (*cached) {
+            return CONN_RESPOND;
+        }
+    } else if (SHOW_TRACKS <= local_cmd && local_cmd < QUIT) {
+        // The response is a copy, so the catalog is only needed while building it
+        struct catalog *cat = (struct catalog *)epoch_enter(ctx->catalog, ctx->reader);
+        construct_ok_response(resp, local_cmd, local_args, &page, cat);
+        epoch_exit(ctx->catalog, ctx->reader);
+    } else if (local_cmd == INSERT_PLAY || local_cmd == INSERT_PLAYS) {
+        construct_insert_response(resp, local_cmd, local_args, ctx);
+    } else if (local_cmd == SET_PROTOCOL) {
+        // Answered in the current encoding; the switch applies from the next response
+        if (strcmp(local_args, "1") == 0 || strcmp(local_args, "2") == 0) {
+            *protocol = strcmp(local_args, "2") == 0 ? PROTOCOL_V2 : PROTOCOL_V1;
+            resp->header.status = OK;
+        } else {
+            construct_err_response(resp, UNKNOWN_ERR);
+        }
+    } else {
+        construct_err_response(resp, UNKNOWN_ERR);
+    }
+
+    if (resp->header.status == OK && encoding == PROTOCOL_V1) {
+        set_v1_check(resp);
+    }
+
+    return CONN_RESPOND;
+}
+
+/**
+ * @brief Create a listening socket on the given port. SO_REUSEPORT lets every
+ * worker bind its own socket to the same port; the kernel spreads incoming
+ * connections across them.
+ *
+ * @return int the socket, or -1 on failure
+ */
+int create_listener(int port) {
+    int server_fd;
     struct sockaddr_in address;
     int opt = 1;
-    int addrlen = sizeof(address);
 
     // Create socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         perror("Socket failed");
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
-    // Set socket options to reuse address and port
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
+    // Set socket options to reuse address and port (one option per call)
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
         perror("setsockopt failed");
-        exit(EXIT_FAILURE);
+        close(server_fd);
+        return -1;
     }
 
     // Set up address struct
+    memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port); // Convert to network byte order
@@ -711,166 +1134,391 @@ int main(int argc, char *argv[]) {
     // Bind the socket
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("Bind failed");
-        exit(EXIT_FAILURE);
+        close(server_fd);
+        return -1;
     }
 
     // Listen for incoming connections
-    if (listen(server_fd, 3) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("Listen failed");
-        exit(EXIT_FAILURE);
+        close(server_fd);
+        return -1;
     }
 
-    printf("Server listening on localhost:%d\n", port);
+    return server_fd;
+}
 
-    while (keep_running) {
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {
-            perror("Accept failed");
-            exit(EXIT_FAILURE);
+/**
+ * @brief One acceptor shard: a private listening socket and event loop.
+ * Every worker reads the same catalog through its own server_ctx.
+ */
+struct worker {
+    pthread_t thread;
+    int listen_fd;
+    bool use_uring;
+    struct server_ctx ctx;
+};
+
+void *worker_main(void *arg) {
+    struct worker *w = (struct worker *)arg;
+    if (w->use_uring) {
+        if (suring_run(w->listen_fd, wake_fd, handle_request, &w->ctx, &keep_running) == 0) {
+            return NULL;
         }
+        fprintf(stderr, "io_uring unavailable, falling back to epoll\n");
+    }
+    sevent_run(w->listen_fd, wake_fd, handle_request, &w->ctx, &keep_running);
+    return NULL;
+}
 
-        printf("Connection accepted from %s:%d\n", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-
-        while (1) {
-            // Read the request
-            struct request_msg request = {0};
-            int read_size = recv(new_socket, &request, sizeof(request), 0);
-            if (read_size == 0) {
-                // The client has gracefully closed the connection.
-                printf("Client disconnected.\n");
-                close(new_socket);
-                break;  // Exit the inner loop to accept a new connection.
-            } else if (read_size < 0) {
-                perror("recv failed");
-                close(new_socket);
-                close(server_fd);
-                exit(EXIT_FAILURE);
-            }
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <FILE_NAME> <PORT> [--workers N] [--backend epoll|uring] [--snapshot]\n"
+                    "       [--write-snapshot PATH] [--cache-bytes N]\n", prog);
+    fprintf(stderr, "  --snapshot            FILE_NAME is a snapshot to serve instead of a CSV\n");
+    fprintf(stderr, "  --write-snapshot PATH save the catalog built from the CSV to PATH, then serve\n");
+    fprintf(stderr, "  --cache-bytes N       keep up to N bytes of SHOW and SEARCH answers to resend\n"
+                    "                        (default %u; 0 turns the cache off)\n", RESPONSE_CACHE_BYTES);
+    fprintf(stderr, "  SIGHUP reloads FILE_NAME (and rewrites the snapshot) without dropping clients;\n"
+                    "  plays added with INSERT_PLAY since the last load are not kept\n");
+}
 
-            // Copy over command and args to parse
-            local_cmd = request.command;
-            strncpy(local_args, clean_str(request.args), sizeof(local_args) - 1);
-            local_args[sizeof(local_args) - 1] = '\0';  // Ensure null termination
+/**
+ * @brief Free the plays and the three record tables, with every record they
+ * hold (the tables' keys point into the records). Any of them may be NULL.
+ */
+static void free_loaded(struct slist *plays, struct htable *tracks, struct htable *albums,
+                        struct htable *playlists) {
+    struct htable *tables[] = { tracks, albums, playlists };
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+        if (!tables[t]) {
+            continue;
+        }
+        void **values = htable_values(tables[t]);
+        for (uint32_t i = 0; values && i < htable_num_elems(tables[t]); i++) {
+            free(values[i]);
+        }
+        free(values);
+        htable_destroy(tables[t]);
+    }
+    slist_destroy(plays, 1);
+}
 
-            // Initialize response data
-            struct response_msg resp = {0};
+/**
+ * @brief Load the CSV at path and build the catalog from it on build_threads threads.
+ *
+ * @return struct catalog* the catalog, or NULL (reported on stderr)
+ */
+static struct catalog *load_catalog(const char *path, uint32_t build_threads) {
+    // Create the data structures
+    struct slist *plays = slist_create();
+    struct htable *tracks = htable_create(1024);
+    struct htable *albums = htable_create(1024);
+    struct htable *playlists = htable_create(128);
+    if (!plays || !tracks || !albums || !playlists) {
+        perror("Error creating data.");
+        free_loaded(plays, tracks, albums, playlists);
+        return NULL;
+    }
 
-            // Checksum check
-            struct request_msg temp = request;
-            temp.check = 0;  // Zero out the checksum field before computing
-            unsigned int check = compute_checksum(&temp, sizeof(temp), 7331);
-            if (check != request.check) {
-                construct_err_response(&resp, CHECK_SUM_ERR);
-            }
+    // Read data from the file; whatever it loaded before failing is freed too
+    if (csv_load(path, plays, tracks, albums, playlists, build_threads) < 0) {
+        free_loaded(plays, tracks, albums, playlists);
+        return NULL;
+    }
 
+#ifdef DEBUG
+    htable_print_stats(stdout, "tracks", tracks);
+    htable_print_stats(stdout, "albums", albums);
+    htable_print_stats(stdout, "playlists", playlists);
+#endif
+
+    // Sorted views and dense-ID relations answer every query; the catalog
+    // keeps its own copies, so the loaded records can go right away
+    struct catalog *cat = catalog_create(plays, tracks, albums, playlists, build_threads);
+    if (!cat) {
+        perror("Error creating catalog.");
+    }
 
-            // Validate command
-            else if (local_cmd < SHOW_TRACKS || local_cmd > QUIT) {
-                construct_err_response(&resp, INVALID_CMD_ERR);
-            }
+    free_loaded(plays, tracks, albums, playlists);
+    return cat;
+}
 
-            // TODO: Fix this later
-            // Check if args are empty
-            // else if (strlen(local_args) == 0) {
-            //     construct_err_response(&resp, ZERO_ARGS_ERR);
-            // }
+/**
+ * @brief Where the catalog comes from: the command line, kept for reloads.
+ */
+struct dataset {
+    const char *path;               // CSV, or snapshot with from_snapshot
+    bool from_snapshot;
+    const char *snapshot_path;      // rewritten after every CSV load, if set
+};
+
+/**
+ * @brief Build (or map) a catalog from the dataset and save its snapshot if asked to.
+ *
+ * @return struct catalog* the catalog, or NULL (reported on stderr)
+ */
+static struct catalog *open_catalog(const struct dataset *ds, uint32_t build_threads) {
+    struct catalog *cat = ds->from_snapshot ? snapshot_open(ds->path) : load_catalog(ds->path, build_threads);
+    if (cat && ds->snapshot_path && snapshot_write(cat, ds->snapshot_path) < 0) {
+        catalog_destroy(cat);
+        return NULL;
+    }
+    return cat;
+}
 
-            // Handle QUIT command
-            else if (local_cmd == QUIT) {
-                close(new_socket);
-                keep_running = 0;
-                break;
-            } else if (SHOW_TRACKS <= local_cmd && local_cmd < QUIT) {
-                construct_ok_response(&resp, local_cmd, local_args, tracks, albums, playlists, track_by_album, album_by_track, album_by_artist, track_by_playlist);
-            } else {
-                construct_err_response(&resp, UNKNOWN_ERR);
-            }
+/**
+ * @brief The thread that rebuilds the catalog on SIGHUP.
+ */
+struct reloader {
+    pthread_t thread;
+    const struct dataset *ds;
+    struct epoch *catalog;
+};
+
+/**
+ * @brief Wait for SIGHUP (blocked in every thread, so only sigwait() sees it),
+ * build a new generation next to the one being served, publish it, and free
+ * the old one once no request is still reading it. A failed reload keeps the
+ * current generation. Woken with SIGHUP once keep_running is cleared to exit.
+ * The new generation comes from the file alone, so inserted plays are dropped.
+ */
+static void *reloader_main(void *arg) {
+    struct reloader *r = (struct reloader *)arg;
+    sigset_t hup;
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+
+    int sig;
+    while (sigwait(&hup, &sig) == 0 && keep_running) {
+        // Build on one thread and leave the other cores to the workers
+        struct catalog *next = open_catalog(r->ds, 1);
+        if (!next) {
+            fprintf(stderr, "Reload of %s failed; still serving the previous data\n", r->ds->path);
+            continue;
+        }
+        pthread_mutex_lock(&publish_lock);
+        next->generation = r->catalog->generation + 1;
+        catalog_destroy((struct catalog *)epoch_publish(r->catalog, next));
+        printf("Reloaded %s (generation %lu)\n", r->ds->path, (unsigned long)r->catalog->generation);
+        fflush(stdout);
+        pthread_mutex_unlock(&publish_lock);
+    }
+    return NULL;
+}
 
-            // Compute the checksum exactly as in the demo
-            // Zero out the check field before computing the checksum.
-            if (resp.header.status == OK) {
-                resp.header.check = 0;
-                unsigned int checksum = compute_checksum(&resp.header, sizeof(resp.header), 1337);
-                checksum += compute_checksum(resp.data.tracks, resp.header.num_tracks * sizeof(struct track), checksum);
-                checksum += compute_checksum(resp.data.albums, resp.header.num_albums * sizeof(struct album), checksum);
-                checksum += compute_checksum(resp.data.playlists, resp.header.num_playlists * sizeof(struct playlist), checksum);
-                resp.header.check = checksum;
-            }
-            
+/**
+ * @brief Take every queued play at once, derive the next generation with
+ * them and publish it; the previous one is freed once no request is still
+ * reading it. Requests keep reading whichever generation is current and
+ * never wait for this. Woken through ready once keep_running is cleared to exit.
+ */
+static void *ingest_main(void *arg) {
+    struct ingest *in = (struct ingest *)arg;
 
-            // Send the resp header
-            if (send(new_socket, &resp.header, sizeof(resp.header), 0) != sizeof(resp.header)) {
-                perror("send header failed");
-                // Handle error...
-            }
+    pthread_mutex_lock(&in->lock);
+    while (keep_running) {
+        if (in->num_pending == 0) {
+            pthread_cond_wait(&in->ready, &in->lock);
+            continue;
+        }
+        struct play *batch = in->pending;
+        size_t n = in->num_pending;
+        in->pending = NULL;
+        in->num_pending = 0;
+        in->capacity = 0;
+        pthread_mutex_unlock(&in->lock);
+
+        // Only publishers replace current, and the lock keeps the reloader out
+        pthread_mutex_lock(&publish_lock);
+        size_t num_new;
+        struct catalog *next = catalog_insert_plays((struct catalog *)in->catalog->current, batch, n, &num_new);
+        if (next) {
+            next->generation = in->catalog->generation + 1;
+            catalog_destroy((struct catalog *)epoch_publish(in->catalog, next));
+            printf("Inserted %zu new plays (generation %lu)\n", num_new, (unsigned long)in->catalog->generation);
+            fflush(stdout);
+        } else if (num_new > 0) {
+            fprintf(stderr, "Error: out of memory inserting %zu plays; they were dropped\n", n);
+        }
+        pthread_mutex_unlock(&publish_lock);
+        free(batch);
 
-            // Depending on the status, send either error message or the data arrays
-            if (resp.header.status == ERROR) {
-                if (send(new_socket, resp.error_message, sizeof(resp.error_message), 0) != sizeof(resp.error_message)) {
-                    perror("send error message failed");
-                    // Handle error...
-                }
-            } else if (resp.header.status == OK) {
-                if (resp.header.num_tracks > 0) {
-                    if (send(new_socket, resp.data.tracks, sizeof(struct track) * resp.header.num_tracks, 0)
-                        != (ssize_t)(sizeof(struct track) * resp.header.num_tracks)) {
-                        perror("send tracks failed");
-                        // Handle error...
-                    }
-                }
-                if (resp.header.num_albums > 0) {
-                    if (send(new_socket, resp.data.albums, sizeof(struct album) * resp.header.num_albums, 0)
-                        != (ssize_t)(sizeof(struct album) * resp.header.num_albums)) {
-                        perror("send albums failed");
-                        // Handle error...
-                    }
-                }
-                if (resp.header.num_playlists > 0) {
-                    if (send(new_socket, resp.data.playlists, sizeof(struct playlist) * resp.header.num_playlists, 0)
-                        != (ssize_t)(sizeof(struct playlist) * resp.header.num_playlists)) {
-                        perror("send playlists failed");
-                        // Handle error...
-                    }
-                }
+        pthread_mutex_lock(&in->lock);
+    }
+    pthread_mutex_unlock(&in->lock);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    putenv("TZ=US/Eastern");
+	tzset();
+    // Validate arguments
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // SIGHUP asks for a reload; only the reloader thread takes it (with
+    // sigwait), so block it before any thread exists to inherit the mask
+    sigset_t hup;
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup, NULL);
+
+    // Optional flags
+    int num_workers = 1;
+    bool use_uring = false;
+    size_t cache_bytes = RESPONSE_CACHE_BYTES;
+    struct dataset ds = { argv[1], false, NULL };
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            // 0 means one worker per online core
+            num_workers = atoi(argv[++i]);
+            if (num_workers <= 0) {
+                num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            if (num_workers > MAX_WORKERS) {
+                num_workers = MAX_WORKERS;
             }
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "epoll") == 0 || strcmp(argv[i + 1], "uring") == 0)) {
+            use_uring = strcmp(argv[++i], "uring") == 0;
+        } else if (strcmp(argv[i], "--snapshot") == 0) {
+            ds.from_snapshot = true;
+        } else if (strcmp(argv[i], "--write-snapshot") == 0 && i + 1 < argc) {
+            ds.snapshot_path = argv[++i];
+        } else if (strcmp(argv[i], "--cache-bytes") == 0 && i + 1 < argc && isdigit((unsigned char)*argv[i + 1])) {
+            cache_bytes = (size_t)strtoull(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
 
+    // Convert port argument to integer
+    int port = atoi(argv[2]);
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "Invalid port number: %s\n", argv[2]);
+        return 1;
+    }
 
-            printf("Response sent.\n");
-            free_resp(&resp);
+    // SET UP DATA ==========================================================================================
+    // A snapshot is mapped as it is; a CSV is parsed and indexed. Nothing is
+    // serving yet, so loading and indexing may use every core
+    struct catalog *cat = open_catalog(&ds, (uint32_t)sysconf(_SC_NPROCESSORS_ONLN));
+    if (!cat) {
+        return 2;
+    }
+
+    // Workers read the catalog through the epoch, one reader slot each, so a
+    // reload can swap it under them
+    struct epoch catalog_epoch;
+    if (epoch_init(&catalog_epoch, cat, (uint32_t)num_workers) < 0) {
+        perror("Error creating data.");
+        return 3;
+    }
+
+    // Inserted plays become new generations on a thread of their own
+    struct ingest ingest = { 0 };
+    ingest.catalog = &catalog_epoch;
+    pthread_mutex_init(&ingest.lock, NULL);
+    pthread_cond_init(&ingest.ready, NULL);
+    if (pthread_create(&ingest.thread, NULL, ingest_main, &ingest) != 0) {
+        perror("pthread_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Repeated SHOW and SEARCH requests are answered with the bytes sent last time
+    struct scache cache;
+    bool caching = cache_bytes > 0;
+    if (caching && scache_init(&cache, cache_bytes) < 0) {
+        perror("Error creating response cache");
+        return 3;
+    }
+
+    // Stop cleanly on Ctrl-C; a client hanging up mid-send must not kill us
+    struct sigaction sa = {0};
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // SET UP SERVER SOCKETS ===============================================================================
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        perror("eventfd failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Bind every shard up front so a bad port fails before any thread starts
+    struct worker *workers = (struct worker *)calloc(num_workers, sizeof(struct worker));
+    if (!workers) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        workers[i].ctx.catalog = &catalog_epoch;
+        workers[i].ctx.reader = (uint32_t)i;
+        workers[i].ctx.ingest = &ingest;
+        workers[i].ctx.cache = caching ? &cache : NULL;
+        workers[i].use_uring = use_uring;
+        workers[i].listen_fd = create_listener(port);
+        if (workers[i].listen_fd < 0) {
+            exit(EXIT_FAILURE);
         }
-        printf("Disconnecting\n");
-        
-        close(new_socket);
     }
-    close(server_fd);
 
-    // Clean up allocated memory
-    char **values1 = (char **)htable_values(tracks);
-    char **values2 = (char **)htable_values(albums);
-    char **values3 = (char **)htable_values(playlists);
+    printf("Server listening on localhost:%d (%d worker%s, %s)\n", port, num_workers, num_workers == 1 ? "" : "s",
+           use_uring ? "io_uring" : "epoll");
 
-    for (uint32_t i = 0; i < htable_num_elems(tracks); i++) {		
-		free(values1[i]);
-	}
-    for (uint32_t i = 0; i < htable_num_elems(albums); i++) {		
-		free(values2[i]);
-	}
-    for (uint32_t i = 0; i < htable_num_elems(playlists); i++) {		
-		free(values3[i]);
-	}
+    // Each worker multiplexes its own clients on its own event loop until QUIT or SIGINT.
+    // Worker 0 runs on the main thread.
+    for (int i = 1; i < num_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            perror("pthread_create failed");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    free(values1);
-    free(values2);
-    free(values3);
+    // Reloads are built beside the workers; without the thread SIGHUP stays blocked and ignored
+    struct reloader reloader = { 0, &ds, &catalog_epoch };
+    bool reloading = pthread_create(&reloader.thread, NULL, reloader_main, &reloader) == 0;
+    if (!reloading) {
+        perror("pthread_create failed (SIGHUP reloads disabled)");
+    }
 
-    slist_destroy(plays, 1);
-    htable_destroy(tracks);
-    htable_destroy(albums);
-    htable_destroy(playlists);
-
-    htable_destroy_slist_values(track_by_album);
-    htable_destroy_slist_values(album_by_track);
-    htable_destroy_slist_values(album_by_artist);
-    htable_destroy_slist_values(track_by_playlist);
+    worker_main(&workers[0]);
+    for (int i = 1; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    if (reloading) {
+        keep_running = 0;
+        pthread_kill(reloader.thread, SIGHUP);
+        pthread_join(reloader.thread, NULL);
+    }
+    pthread_mutex_lock(&ingest.lock);
+    keep_running = 0;
+    pthread_cond_signal(&ingest.ready);
+    pthread_mutex_unlock(&ingest.lock);
+    pthread_join(ingest.thread, NULL);
+    free(ingest.pending);
+    pthread_mutex_destroy(&ingest.lock);
+    pthread_cond_destroy(&ingest.ready);
+
+    for (int i = 0; i < num_workers; i++) {
+        close(workers[i].listen_fd);
+    }
+    free(workers);
+    close(wake_fd);
+
+    if (caching) {
+        scache_print_stats(stdout, &cache);
+        scache_destroy(&cache);
+    }
+
+    // Clean up allocated memory (the catalog may be a reloaded one by now)
+    catalog_destroy((struct catalog *)catalog_epoch.current);
+    epoch_destroy(&catalog_epoch);
 
     return 0;
 }
@@ -0,0 +1,318 @@
+/**
+ * @file ssnapshot.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Binary snapshot of a built catalog, served straight from the page cache.
+ * @version 0.1
+ * @date 2025-04-21
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ssnapshot.h"
+
+#define SNAPSHOT_MAGIC "SPOTSNAP"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// Every section starts on a multiple of this
+#define SNAPSHOT_ALIGN 64
+
+// Arrays of one trigram index, in file order
+enum { TRI_FOLDED, TRI_FOLDED_OFF, TRI_KEYS, TRI_OFFSETS, TRI_POSTINGS, NUM_TRI_ARRAYS };
+
+// Which trigram index a group of sections belongs to
+enum { IDX_TRACK_NAMES, IDX_ALBUM_NAMES, IDX_PLAYLIST_NAMES, IDX_ARTIST_NAMES, NUM_INDEXES };
+
+// Every array in the file, in file order
+enum {
+    SEC_TRACKS, SEC_ALBUMS, SEC_PLAYLISTS,
+    SEC_ARTISTS,                    // track whose artist field names each artist
+    SEC_TRACK_ARTIST,
+    SEC_ALBUM_TRACKS_OFF, SEC_ALBUM_TRACKS_IDS,
+    SEC_TRACK_ALBUMS_OFF, SEC_TRACK_ALBUMS_IDS,
+    SEC_ARTIST_ALBUMS_OFF, SEC_ARTIST_ALBUMS_IDS,
+    SEC_PLAYLIST_TRACKS_OFF, SEC_PLAYLIST_TRACKS_IDS,
+    SEC_INDEXES,                    // NUM_TRI_ARRAYS sections per index from here
+    NUM_SECTIONS = SEC_INDEXES + NUM_INDEXES * NUM_TRI_ARRAYS
+};
+
+struct snapshot_section {
+    uint64_t offset;                // from the start of the file
+    uint64_t size;                  // bytes
+};
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;            // SNAPSHOT_BYTE_ORDER as the writer stored it
+    uint32_t track_size;            // sizeof the record structs, as a layout check
+    uint32_t album_size;
+    uint32_t playlist_size;
+    uint32_t num_sections;
+    uint64_t file_size;
+    struct snapshot_section sections[NUM_SECTIONS];
+};
+
+/**
+ * @brief Where one section's bytes are in memory, and how big one element is.
+ */
+struct snapshot_array {
+    const void *data;
+    uint64_t size;
+    size_t elem;
+};
+
+static struct trigram_index *const *index_slot(const struct catalog *cat, int which) {
+    switch (which) {
+    case IDX_TRACK_NAMES:    return &cat->track_names;
+    case IDX_ALBUM_NAMES:    return &cat->album_names;
+    case IDX_PLAYLIST_NAMES: return &cat->playlist_names;
+    default:                 return &cat->artist_names;
+    }
+}
+
+static uint64_t align_up(uint64_t n) {
+    return (n + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+static void set_array(struct snapshot_array *a, const void *data, uint64_t count, size_t elem) {
+    a->data = data;
+    a->size = count * elem;
+    a->elem = elem;
+}
+
+static void set_csr(struct snapshot_array *a, const struct csr *rel, uint32_t num_rows) {
+    set_array(&a[0], rel->offsets, num_rows + 1, sizeof(uint32_t));
+    set_array(&a[1], rel->ids, rel->offsets[num_rows], sizeof(uint32_t));
+}
+
+int snapshot_write(const struct catalog *cat, const char *path) {
+    // Only the base arrays of a relation have sections; inserted plays are patches
+    if (cat->album_tracks.num_patched || cat->track_albums.num_patched || cat->artist_albums.num_patched ||
+        cat->playlist_tracks.num_patched) {
+        fprintf(stderr, "Error: a catalog with inserted plays cannot be written as a snapshot\n");
+        return -1;
+    }
+
+    // Artists are stored as the track each name points into
+    uint32_t *artist_track = (uint32_t *)malloc((cat->num_artists + 1) * sizeof(uint32_t));
+    if (!artist_track) {
+        fprintf(stderr, "Error: out of memory writing the snapshot\n");
+        return -1;
+    }
+    for (uint32_t i = 0; i < cat->num_artists; i++) {
+        artist_track[i] = (uint32_t)(((const char *)cat->artists[i] - (const char *)cat->tracks) / sizeof(struct track));
+    }
+
+    struct snapshot_array arrays[NUM_SECTIONS];
+    set_array(&arrays[SEC_TRACKS], cat->tracks, cat->num_tracks, sizeof(struct track));
+    set_array(&arrays[SEC_ALBUMS], cat->albums, cat->num_albums, sizeof(struct album));
+    set_array(&arrays[SEC_PLAYLISTS], cat->playlists, cat->num_playlists, sizeof(struct playlist));
+    set_array(&arrays[SEC_ARTISTS], artist_track, cat->num_artists, sizeof(uint32_t));
+    set_array(&arrays[SEC_TRACK_ARTIST], cat->track_artist, cat->num_tracks, sizeof(uint32_t));
+    set_csr(&arrays[SEC_ALBUM_TRACKS_OFF], &cat->album_tracks, cat->num_albums);
+    set_csr(&arrays[SEC_TRACK_ALBUMS_OFF], &cat->track_albums, cat->num_tracks);
+    set_csr(&arrays[SEC_ARTIST_ALBUMS_OFF], &cat->artist_albums, cat->num_artists);
+    set_csr(&arrays[SEC_PLAYLIST_TRACKS_OFF], &cat->playlist_tracks, cat->num_playlists);
+    for (int i = 0; i < NUM_INDEXES; i++) {
+        const struct trigram_index *idx = *index_slot(cat, i);
+        struct snapshot_array *a = &arrays[SEC_INDEXES + i * NUM_TRI_ARRAYS];
+        uint64_t folded_size = 0;
+        if (idx->num_items > 0) {
+            const char *last = idx->folded + idx->folded_off[idx->num_items - 1];
+            folded_size = (uint64_t)(last - idx->folded) + strlen(last) + 1;
+        }
+        set_array(&a[TRI_FOLDED], idx->folded, folded_size, 1);
+        set_array(&a[TRI_FOLDED_OFF], idx->folded_off, idx->num_items, sizeof(uint32_t));
+        set_array(&a[TRI_KEYS], idx->keys, idx->num_keys, sizeof(uint32_t));
+        set_array(&a[TRI_OFFSETS], idx->offsets, idx->num_keys + 1, sizeof(uint32_t));
+        set_array(&a[TRI_POSTINGS], idx->postings, idx->offsets[idx->num_keys], sizeof(uint32_t));
+    }
+
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.track_size = sizeof(struct track);
+    header.album_size = sizeof(struct album);
+    header.playlist_size = sizeof(struct playlist);
+    header.num_sections = NUM_SECTIONS;
+    uint64_t pos = align_up(sizeof(header));
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+        header.sections[s].offset = pos;
+        header.sections[s].size = arrays[s].size;
+        pos = align_up(pos + arrays[s].size);
+    }
+    header.file_size = pos;
+
+    // Write beside the target, then swap it in
+    size_t tmp_len = strlen(path) + 5;
+    char *tmp = (char *)malloc(tmp_len);
+    FILE *fp = NULL;
+    if (tmp) {
+        snprintf(tmp, tmp_len, "%s.tmp", path);
+        fp = fopen(tmp, "wb");
+    }
+    if (!fp) {
+        perror("Error writing snapshot");
+        free(tmp);
+        free(artist_track);
+        return -1;
+    }
+
+    static const char zeros[SNAPSHOT_ALIGN];
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    uint64_t written = sizeof(header);
+    for (int s = 0; ok && s < NUM_SECTIONS; s++) {
+        ok = fwrite(zeros, 1, header.sections[s].offset - written, fp) == header.sections[s].offset - written &&
+             (arrays[s].size == 0 || fwrite(arrays[s].data, 1, arrays[s].size, fp) == arrays[s].size);
+        written = header.sections[s].offset + arrays[s].size;
+    }
+    ok = ok && fwrite(zeros, 1, header.file_size - written, fp) == header.file_size - written;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp, path) < 0) {
+        perror("Error writing snapshot");
+        unlink(tmp);
+        ok = 0;
+    }
+    free(tmp);
+    free(artist_track);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Point at a section, checking that it holds whole elements and lies in the file.
+ *
+ * @return void* its first byte, or NULL if the section is malformed
+ */
+static void *section(const struct snapshot_header *h, int s, size_t elem, uint64_t *count) {
+    const struct snapshot_section *sec = &h->sections[s];
+    if (sec->offset % SNAPSHOT_ALIGN != 0 || sec->offset > h->file_size || sec->size > h->file_size - sec->offset ||
+        sec->size % elem != 0 || sec->size / elem > UINT32_MAX) {
+        return NULL;
+    }
+    *count = sec->size / elem;
+    return (char *)h + sec->offset;
+}
+
+/**
+ * @brief Attach a CSR relation with num_rows rows whose offsets end at its ID count.
+ */
+static int map_csr(const struct snapshot_header *h, int s, struct csr *rel, uint32_t num_rows) {
+    uint64_t num_offsets, num_ids;
+    rel->offsets = (uint32_t *)section(h, s, sizeof(uint32_t), &num_offsets);
+    rel->ids = (uint32_t *)section(h, s + 1, sizeof(uint32_t), &num_ids);
+    rel->borrowed = true;
+    return rel->offsets && rel->ids && num_offsets == (uint64_t)num_rows + 1 && rel->offsets[0] == 0 &&
+           rel->offsets[num_rows] == num_ids ? 0 : -1;
+}
+
+/**
+ * @brief Attach a trigram index of num_items items.
+ */
+static struct trigram_index *map_index(const struct snapshot_header *h, int first, uint32_t num_items) {
+    uint64_t folded_size, num_off, num_keys, num_offsets, num_postings;
+    struct trigram_index *idx = (struct trigram_index *)calloc(1, sizeof(struct trigram_index));
+    if (!idx) {
+        return NULL;
+    }
+    idx->folded = (char *)section(h, first + TRI_FOLDED, 1, &folded_size);
+    idx->folded_off = (uint32_t *)section(h, first + TRI_FOLDED_OFF, sizeof(uint32_t), &num_off);
+    idx->keys = (uint32_t *)section(h, first + TRI_KEYS, sizeof(uint32_t), &num_keys);
+    idx->offsets = (uint32_t *)section(h, first + TRI_OFFSETS, sizeof(uint32_t), &num_offsets);
+    idx->postings = (uint32_t *)section(h, first + TRI_POSTINGS, sizeof(uint32_t), &num_postings);
+    idx->num_items = num_items;
+    idx->num_keys = (uint32_t)num_keys;
+    if (!idx->folded || !idx->folded_off || !idx->keys || !idx->offsets || !idx->postings ||
+        num_off != num_items || num_offsets != num_keys + 1 || idx->offsets[num_keys] != num_postings ||
+        (folded_size > 0 && idx->folded[folded_size - 1] != '\0') || (num_items > 0 && folded_size == 0)) {
+        free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+struct catalog *snapshot_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("Error opening snapshot");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct snapshot_header)) {
+        fprintf(stderr, "Error: %s is not a snapshot\n", path);
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Error mapping snapshot");
+        return NULL;
+    }
+
+    const struct snapshot_header *h = (const struct snapshot_header *)map;
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 || h->byte_order != SNAPSHOT_BYTE_ORDER ||
+        h->version != SNAPSHOT_VERSION || h->track_size != sizeof(struct track) ||
+        h->album_size != sizeof(struct album) || h->playlist_size != sizeof(struct playlist) ||
+        h->num_sections != NUM_SECTIONS || h->file_size != (uint64_t)st.st_size) {
+        fprintf(stderr, "Error: %s is not a version %d snapshot written by this build\n", path, SNAPSHOT_VERSION);
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+
+    struct catalog *cat = (struct catalog *)calloc(1, sizeof(struct catalog));
+    if (!cat) {
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+    cat->map = map;
+    cat->map_size = (size_t)st.st_size;
+
+    uint64_t num_tracks, num_albums, num_playlists, num_artists, num_track_artist;
+    cat->tracks = (struct track *)section(h, SEC_TRACKS, sizeof(struct track), &num_tracks);
+    cat->albums = (struct album *)section(h, SEC_ALBUMS, sizeof(struct album), &num_albums);
+    cat->playlists = (struct playlist *)section(h, SEC_PLAYLISTS, sizeof(struct playlist), &num_playlists);
+    const uint32_t *artist_track = (const uint32_t *)section(h, SEC_ARTISTS, sizeof(uint32_t), &num_artists);
+    cat->track_artist = (uint32_t *)section(h, SEC_TRACK_ARTIST, sizeof(uint32_t), &num_track_artist);
+    int ok = cat->tracks && cat->albums && cat->playlists && artist_track && cat->track_artist &&
+             num_track_artist == num_tracks;
+    if (ok) {
+        cat->num_tracks = (uint32_t)num_tracks;
+        cat->num_albums = (uint32_t)num_albums;
+        cat->num_playlists = (uint32_t)num_playlists;
+        cat->num_artists = (uint32_t)num_artists;
+        cat->artists = (const char **)malloc((num_artists + 1) * sizeof(char *));
+        ok = cat->artists != NULL;
+    }
+    for (uint32_t i = 0; ok && i < cat->num_artists; i++) {
+        ok = artist_track[i] < cat->num_tracks;
+        cat->artists[i] = ok ? cat->tracks[artist_track[i]].artist : NULL;
+    }
+
+    ok = ok && map_csr(h, SEC_ALBUM_TRACKS_OFF, &cat->album_tracks, cat->num_albums) == 0 &&
+         map_csr(h, SEC_TRACK_ALBUMS_OFF, &cat->track_albums, cat->num_tracks) == 0 &&
+         map_csr(h, SEC_ARTIST_ALBUMS_OFF, &cat->artist_albums, cat->num_artists) == 0 &&
+         map_csr(h, SEC_PLAYLIST_TRACKS_OFF, &cat->playlist_tracks, cat->num_playlists) == 0;
+    if (ok) {
+        cat->track_names = map_index(h, SEC_INDEXES + IDX_TRACK_NAMES * NUM_TRI_ARRAYS, cat->num_tracks);
+        cat->album_names = map_index(h, SEC_INDEXES + IDX_ALBUM_NAMES * NUM_TRI_ARRAYS, cat->num_albums);
+        cat->playlist_names = map_index(h, SEC_INDEXES + IDX_PLAYLIST_NAMES * NUM_TRI_ARRAYS, cat->num_playlists);
+        cat->artist_names = map_index(h, SEC_INDEXES + IDX_ARTIST_NAMES * NUM_TRI_ARRAYS, cat->num_artists);
+        ok = cat->track_names && cat->album_names && cat->playlist_names && cat->artist_names;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: snapshot %s is damaged\n", path);
+        catalog_destroy(cat);
+        return NULL;
+    }
+    return cat;
+}
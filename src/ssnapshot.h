@@ -0,0 +1,46 @@
+#ifndef SSNAPSHOT_H
+#define SSNAPSHOT_H
+
+/**
+ * @file ssnapshot.h
+ * @brief Binary snapshot of a built catalog, served straight from the page cache.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-04-21
+ *
+ * A snapshot is a header followed by every catalog array (records, CSR
+ * relations, trigram indexes) laid out back to back, each at a 64-byte
+ * aligned offset. The header lists where each array starts and how long it
+ * is, as offsets from the start of the file, so nothing in the file is a
+ * pointer and it can be mapped at any address. Opening one maps it read-only
+ * and points a catalog at the mapped arrays: there is nothing to parse or
+ * sort, and every server mapping the same file shares its pages.
+ *
+ * The header also records the format version, the byte order and the sizes
+ * of the record structs, and a file written by a different build is
+ * refused rather than misread.
+ */
+
+#include "scatalog.h"
+
+// Bump whenever the layout of the file or of a record struct changes
+#define SNAPSHOT_VERSION 1
+
+/**
+ * @brief Write cat to path (through a temporary file renamed into place, so
+ * a server opening path never sees half a snapshot).
+ *
+ * @return int 0, or -1 on an I/O error (reported on stderr)
+ */
+int snapshot_write(const struct catalog *cat, const char *path);
+
+/**
+ * @brief Map the snapshot at path and build a catalog on top of it. Only the
+ * shape of the file is checked (header, section bounds, relation lengths),
+ * not every ID in it. catalog_destroy() unmaps it.
+ *
+ * @return struct catalog* the catalog, or NULL if the file cannot be mapped
+ * or is not a snapshot of this version (reported on stderr)
+ */
+struct catalog *snapshot_open(const char *path);
+
+#endif // SSNAPSHOT_H
@@ -0,0 +1,237 @@
+/**
+ * @file strigram.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Trigram inverted index for case-insensitive substring search.
+ * @version 0.1
+ * @date 2025-04-02
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sradix.h"
+#include "strigram.h"
+
+// Most distinct trigrams taken from a query (a 255-byte keyword has at most 253)
+#define MAX_QUERY_TRIGRAMS 256
+
+static uint32_t pack_trigram(const char *s) {
+    return ((uint32_t)(unsigned char)s[0] << 16) | ((uint32_t)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+struct trigram_index *trigram_index_create(const char **strings, uint32_t n) {
+    struct trigram_index *idx = (struct trigram_index *)calloc(1, sizeof(struct trigram_index));
+    if (!idx) {
+        return NULL;
+    }
+    idx->num_items = n;
+
+    // Upper-case every string once, the same way strcaps() folds a keyword
+    size_t total = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        total += strlen(strings[i]) + 1;
+    }
+    idx->folded = (char *)malloc(total > 0 ? total : 1);
+    idx->folded_off = (uint32_t *)malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+    if (!idx->folded || !idx->folded_off) {
+        trigram_index_destroy(idx);
+        return NULL;
+    }
+
+    size_t pos = 0;
+    size_t num_pairs = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        idx->folded_off[i] = (uint32_t)pos;
+        size_t len = strlen(strings[i]);
+        for (size_t j = 0; j < len; j++) {
+            idx->folded[pos + j] = (char)toupper((unsigned char)strings[i][j]);
+        }
+        idx->folded[pos + len] = '\0';
+        pos += len + 1;
+        if (len >= 3) {
+            num_pairs += len - 2;
+        }
+    }
+
+    // Every (trigram, item) occurrence, sorted and de-duplicated
+    uint64_t *pairs = (uint64_t *)malloc((num_pairs > 0 ? num_pairs : 1) * sizeof(uint64_t));
+    if (!pairs) {
+        trigram_index_destroy(idx);
+        return NULL;
+    }
+    size_t p = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const char *s = idx->folded + idx->folded_off[i];
+        for (size_t j = 0; s[j] && s[j + 1] && s[j + 2]; j++) {
+            pairs[p++] = ((uint64_t)pack_trigram(s + j) << 32) | i;
+        }
+    }
+    if (radix_sort_u64(pairs, p, 0) < 0) {
+        free(pairs);
+        trigram_index_destroy(idx);
+        return NULL;
+    }
+
+    size_t uniq = 0;
+    uint32_t num_keys = 0;
+    for (size_t j = 0; j < p; j++) {
+        if (uniq > 0 && pairs[uniq - 1] == pairs[j]) {
+            continue;
+        }
+        if (uniq == 0 || (pairs[uniq - 1] >> 32) != (pairs[j] >> 32)) {
+            num_keys++;
+        }
+        pairs[uniq++] = pairs[j];
+    }
+
+    // Lay the sorted pairs out as key -> postings ranges
+    idx->num_keys = num_keys;
+    idx->keys = (uint32_t *)malloc((num_keys > 0 ? num_keys : 1) * sizeof(uint32_t));
+    idx->offsets = (uint32_t *)malloc((num_keys + 1) * sizeof(uint32_t));
+    idx->postings = (uint32_t *)malloc((uniq > 0 ? uniq : 1) * sizeof(uint32_t));
+    if (!idx->keys || !idx->offsets || !idx->postings) {
+        free(pairs);
+        trigram_index_destroy(idx);
+        return NULL;
+    }
+
+    uint32_t k = 0;
+    for (size_t j = 0; j < uniq; j++) {
+        uint32_t key = (uint32_t)(pairs[j] >> 32);
+        if (j == 0 || idx->keys[k - 1] != key) {
+            idx->keys[k] = key;
+            idx->offsets[k] = (uint32_t)j;
+            k++;
+        }
+        idx->postings[j] = (uint32_t)pairs[j];
+    }
+    idx->offsets[num_keys] = (uint32_t)uniq;
+    free(pairs);
+
+    return idx;
+}
+
+void trigram_index_destroy(struct trigram_index *idx) {
+    if (!idx) return;
+
+    free(idx->folded);
+    free(idx->folded_off);
+    free(idx->keys);
+    free(idx->offsets);
+    free(idx->postings);
+    free(idx);
+}
+
+/**
+ * @brief Locate the posting list of one trigram.
+ *
+ * @return int 1 if the trigram occurs anywhere, 0 otherwise
+ */
+static int find_postings(const struct trigram_index *idx, uint32_t key, const uint32_t **list, uint32_t *len) {
+    const uint32_t *hit = (const uint32_t *)bsearch(&key, idx->keys, idx->num_keys, sizeof(uint32_t), compare_u32);
+    if (!hit) {
+        return 0;
+    }
+    uint32_t k = (uint32_t)(hit - idx->keys);
+    *list = idx->postings + idx->offsets[k];
+    *len = idx->offsets[k + 1] - idx->offsets[k];
+    return 1;
+}
+
+/**
+ * @brief Keep the candidates that also appear in list. Both are ascending;
+ * the candidates are usually far fewer, so each one is found by binary
+ * search in the part of list not yet passed.
+ *
+ * @return uint32_t number of candidates kept (compacted in place)
+ */
+static uint32_t intersect(uint32_t *cand, uint32_t ncand, const uint32_t *list, uint32_t len) {
+    uint32_t kept = 0;
+    uint32_t lo = 0;
+
+    for (uint32_t i = 0; i < ncand && lo < len; i++) {
+        uint32_t hi = len;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (list[mid] < cand[i]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < len && list[lo] == cand[i]) {
+            cand[kept++] = cand[i];
+        }
+    }
+    return kept;
+}
+
+uint32_t *trigram_index_search(const struct trigram_index *idx, const char *query, uint32_t *count) {
+    *count = 0;
+    size_t qlen = strlen(query);
+    uint32_t *out = NULL;
+
+    // Too short to have a trigram: check every item
+    if (qlen < 3) {
+        for (uint32_t i = 0; i < idx->num_items; i++) {
+            if (strstr(idx->folded + idx->folded_off[i], query) != NULL) {
+                if (!out) {
+                    out = (uint32_t *)malloc(idx->num_items * sizeof(uint32_t));
+                    if (!out) return NULL;
+                }
+                out[(*count)++] = i;
+            }
+        }
+        return out;
+    }
+
+    // Posting list of every distinct query trigram; any missing one means no match
+    const uint32_t *lists[MAX_QUERY_TRIGRAMS];
+    uint32_t lens[MAX_QUERY_TRIGRAMS];
+    uint32_t nlists = 0;
+    uint32_t shortest = 0;
+    for (size_t j = 0; j + 2 < qlen && nlists < MAX_QUERY_TRIGRAMS; j++) {
+        if (!find_postings(idx, pack_trigram(query + j), &lists[nlists], &lens[nlists])) {
+            return NULL;
+        }
+        if (lens[nlists] < lens[shortest]) {
+            shortest = nlists;
+        }
+        nlists++;
+    }
+
+    // Start from the shortest list and narrow it down with the others
+    uint32_t ncand = lens[shortest];
+    out = (uint32_t *)malloc(ncand * sizeof(uint32_t));
+    if (!out) {
+        return NULL;
+    }
+    memcpy(out, lists[shortest], ncand * sizeof(uint32_t));
+    for (uint32_t l = 0; l < nlists && ncand > 0; l++) {
+        if (l != shortest && lists[l] != lists[shortest]) {
+            ncand = intersect(out, ncand, lists[l], lens[l]);
+        }
+    }
+
+    // Having every trigram does not guarantee they are adjacent: verify
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ncand; i++) {
+        if (strstr(idx->folded + idx->folded_off[out[i]], query) != NULL) {
+            out[n++] = out[i];
+        }
+    }
+    *count = n;
+    if (n == 0) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
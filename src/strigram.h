@@ -0,0 +1,52 @@
+#ifndef STRIGRAM_H
+#define STRIGRAM_H
+
+/**
+ * @file strigram.h
+ * @brief Trigram inverted index for case-insensitive substring search.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-04-02
+ *
+ * Every indexed string is upper-cased (the same folding strcaps() applies to
+ * search keywords) and split into overlapping 3-byte trigrams. For each
+ * distinct trigram the index keeps the ascending list of strings containing
+ * it. A query of three or more bytes can only match strings that contain all
+ * of its trigrams, so the search intersects those posting lists, starting
+ * from the shortest, and runs strstr() on the survivors alone.
+ */
+
+#include <stdint.h>
+
+struct trigram_index {
+    uint32_t num_items;
+    char *folded;               // upper-cased copies of every string, NUL separated
+    uint32_t *folded_off;       // offset of item i in folded
+
+    uint32_t num_keys;
+    uint32_t *keys;             // distinct trigrams (3 bytes packed), ascending
+    uint32_t *offsets;          // postings of keys[k] are postings[offsets[k] .. offsets[k + 1])
+    uint32_t *postings;         // item numbers, ascending within each key
+};
+
+/**
+ * @brief Index n strings. Item numbers returned by searches are positions in strings.
+ *
+ * @return struct trigram_index* the index, or NULL if out of memory
+ */
+struct trigram_index *trigram_index_create(const char **strings, uint32_t n);
+
+/**
+ * @brief Free the index.
+ */
+void trigram_index_destroy(struct trigram_index *idx);
+
+/**
+ * @brief Find every item whose upper-cased text contains the already
+ * upper-cased query (an empty query matches everything).
+ *
+ * @param count set to the number of matches
+ * @return uint32_t* ascending item numbers (caller frees; NULL when there are none)
+ */
+uint32_t *trigram_index_search(const struct trigram_index *idx, const char *query, uint32_t *count);
+
+#endif // STRIGRAM_H
@@ -0,0 +1,774 @@
+/**
+ * @file suring.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief io_uring I/O backend for sserver.
+ * @version 0.1
+ * @date 2025-03-21
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "sconn.h"
+#include "suring.h"
+
+// What a completion belongs to, kept in the low bits of user_data
+// (struct conn is at least 8-byte aligned, so the bits are free)
+#define OP_ACCEPT 0
+#define OP_RECV   1
+#define OP_SEND   2
+#define OP_WAKE   3
+#define OP_CANCEL 4
+#define OP_BACKOFF 5
+#define OP_PROBE  6
+#define OP_MASK   7ULL
+
+// Operations that could not get an SQE, retried once the next submit makes room
+#define RETRY_ACCEPT 0x01
+#define RETRY_WAKE   0x02
+#define RETRY_RECV   0x04
+#define RETRY_CANCEL 0x08
+#define RETRY_SEND   0x10
+#define RETRY_BACKOFF 0x20
+
+// How long accepting pauses after running out of descriptors or memory
+#define ACCEPT_BACKOFF_MS 100
+
+// Provided buffer group used for every recv
+#define BUF_GROUP 0
+
+/**
+ * @brief The shared submission/completion rings mapped from the kernel.
+ */
+struct ring {
+    int fd;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned sq_local_tail;     // next slot we fill
+    unsigned to_submit;         // filled but not yet handed to the kernel
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+};
+
+struct suring {
+    struct ring ring;
+
+    // Provided receive buffers
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *buf_mem;
+    unsigned short buf_tail;
+
+    int listen_fd;
+    int wake_fd;
+    bool accept_failing;    // the last accept failed; reported once per run of failures
+    struct __kernel_timespec backoff;   // read by a pending IORING_OP_TIMEOUT
+    struct conn *conns;     // every live connection, for cleanup on exit
+    unsigned retry;         // RETRY_ACCEPT, RETRY_WAKE and RETRY_BACKOFF
+    struct conn *retries;   // connections with an operation to retry
+    request_handler handler;
+    void *ctx;
+    volatile sig_atomic_t *running;
+};
+
+// RING PLUMBING ============================================
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int ring_setup(struct ring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+
+    r->fd = sys_io_uring_setup(entries, &p);
+    if (r->fd < 0) {
+        perror("io_uring_setup failed");
+        return -1;
+    }
+
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size) {
+            r->sq_size = r->cq_size;
+        }
+        r->cq_size = r->sq_size;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        perror("mmap sq ring failed");
+        close(r->fd);
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            perror("mmap cq ring failed");
+            munmap(r->sq_ptr, r->sq_size);
+            close(r->fd);
+            return -1;
+        }
+    }
+
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        perror("mmap sqes failed");
+        if (r->cq_ptr != r->sq_ptr) {
+            munmap(r->cq_ptr, r->cq_size);
+        }
+        munmap(r->sq_ptr, r->sq_size);
+        close(r->fd);
+        return -1;
+    }
+
+    char *sq = (char *)r->sq_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->sq_entries = p.sq_entries;
+    r->sq_local_tail = *r->sq_tail;
+    r->to_submit = 0;
+
+    // SQ slot i always points at SQE i, so the array never changes again
+    for (unsigned i = 0; i < p.sq_entries; i++) {
+        r->sq_array[i] = i;
+    }
+
+    char *cq = (char *)r->cq_ptr;
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return 0;
+}
+
+static void ring_teardown(struct ring *r) {
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_ptr != r->sq_ptr) {
+        munmap(r->cq_ptr, r->cq_size);
+    }
+    munmap(r->sq_ptr, r->sq_size);
+    close(r->fd);
+}
+
+/**
+ * @brief Hand every filled SQE to the kernel, optionally waiting for completions.
+ */
+static int ring_submit(struct ring *r, unsigned wait_nr) {
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret = sys_io_uring_enter(r->fd, r->to_submit, wait_nr, flags);
+    if (ret < 0) {
+        return -errno;
+    }
+    r->to_submit -= (unsigned)ret < r->to_submit ? (unsigned)ret : r->to_submit;
+    return ret;
+}
+
+static unsigned ring_space(struct ring *r) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    return r->sq_entries - (r->sq_local_tail - head);
+}
+
+static struct io_uring_sqe *ring_get_sqe(struct ring *r) {
+    // Full: push what we have to the kernel to make room
+    if (ring_space(r) == 0) {
+        ring_submit(r, 0);
+        if (ring_space(r) == 0) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &r->sqes[r->sq_local_tail & *r->sq_mask];
+    r->sq_local_tail++;
+    r->to_submit++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// PROVIDED BUFFERS =========================================
+
+static int bufs_setup(struct suring *loop) {
+    loop->buf_ring_size = SURING_NUM_BUFS * sizeof(struct io_uring_buf);
+    loop->buf_ring = mmap(NULL, loop->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (loop->buf_ring == MAP_FAILED) {
+        perror("mmap buffer ring failed");
+        return -1;
+    }
+
+    loop->buf_mem = (char *)malloc((size_t)SURING_NUM_BUFS * SURING_BUF_SIZE);
+    if (!loop->buf_mem) {
+        munmap(loop->buf_ring, loop->buf_ring_size);
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)loop->buf_ring;
+    reg.ring_entries = SURING_NUM_BUFS;
+    reg.bgid = BUF_GROUP;
+    if (sys_io_uring_register(loop->ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("io_uring_register(PBUF_RING) failed");
+        free(loop->buf_mem);
+        munmap(loop->buf_ring, loop->buf_ring_size);
+        return -1;
+    }
+
+    loop->buf_tail = 0;
+    for (unsigned short bid = 0; bid < SURING_NUM_BUFS; bid++) {
+        struct io_uring_buf *buf = &loop->buf_ring->bufs[(loop->buf_tail + bid) & (SURING_NUM_BUFS - 1)];
+        buf->addr = (uint64_t)(uintptr_t)(loop->buf_mem + (size_t)bid * SURING_BUF_SIZE);
+        buf->len = SURING_BUF_SIZE;
+        buf->bid = bid;
+    }
+    loop->buf_tail += SURING_NUM_BUFS;
+    __atomic_store_n(&loop->buf_ring->tail, loop->buf_tail, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+static void bufs_recycle(struct suring *loop, unsigned short bid) {
+    struct io_uring_buf *buf = &loop->buf_ring->bufs[loop->buf_tail & (SURING_NUM_BUFS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(loop->buf_mem + (size_t)bid * SURING_BUF_SIZE);
+    buf->len = SURING_BUF_SIZE;
+    buf->bid = bid;
+    loop->buf_tail++;
+    __atomic_store_n(&loop->buf_ring->tail, loop->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void bufs_teardown(struct suring *loop) {
+    free(loop->buf_mem);
+    munmap(loop->buf_ring, loop->buf_ring_size);
+}
+
+// OPERATIONS ===============================================
+
+static uint64_t tag(struct conn *c, uint64_t op) {
+    return (uint64_t)(uintptr_t)c | op;
+}
+
+/**
+ * @brief Remember that c still needs op, for retry_pending() to issue.
+ */
+static void defer(struct suring *loop, struct conn *c, unsigned op) {
+    if (!c->retry) {
+        c->retry_next = loop->retries;
+        loop->retries = c;
+    }
+    c->retry |= op;
+}
+
+static void arm_accept(struct suring *loop) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&loop->ring);
+    if (!sqe) {
+        loop->retry |= RETRY_ACCEPT;
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = tag(NULL, OP_ACCEPT);
+}
+
+/**
+ * @brief Re-arm accept only after a pause, through a timeout that completes
+ * as OP_BACKOFF. Re-arming at once when out of descriptors or memory would
+ * only fail again on the same waiting connection, over and over.
+ */
+static void arm_accept_later(struct suring *loop) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&loop->ring);
+    if (!sqe) {
+        loop->retry |= RETRY_BACKOFF;
+        return;
+    }
+    loop->backoff.tv_sec = 0;
+    loop->backoff.tv_nsec = ACCEPT_BACKOFF_MS * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&loop->backoff;
+    sqe->len = 1;
+    sqe->user_data = tag(NULL, OP_BACKOFF);
+}
+
+static void arm_wake(struct suring *loop) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&loop->ring);
+    if (!sqe) {
+        loop->retry |= RETRY_WAKE;
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = loop->wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = tag(NULL, OP_WAKE);
+}
+
+static void arm_recv(struct suring *loop, struct conn *c) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&loop->ring);
+    if (!sqe) {
+        defer(loop, c, RETRY_RECV);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = tag(c, OP_RECV);
+    c->recv_armed = true;
+}
+
+/**
+ * @brief Stop the multishot recv of a connection whose output has backed up.
+ */
+static void cancel_recv(struct suring *loop, struct conn *c) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&loop->ring);
+    if (!sqe) {
+        defer(loop, c, RETRY_CANCEL);
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = tag(c, OP_RECV);
+    sqe->user_data = tag(NULL, OP_CANCEL);
+}
+
+static void suring_maybe_destroy(struct suring *loop, struct conn *c) {
+    // A conn waiting in the retry list is freed once retry_pending() drops it
+    if (!c->dead || c->recv_armed || c->sends_inflight > 0 || c->retry) {
+        return;
+    }
+
+    if (c->prev) {
+        c->prev->next = c->next;
+    } else {
+        loop->conns = c->next;
+    }
+    if (c->next) {
+        c->next->prev = c->prev;
+    }
+    conn_destroy(c);
+}
+
+/**
+ * @brief Tear a connection down. shutdown() makes the kernel complete its
+ * pending recv and sends; the completion handler that sees the last of them
+ * frees the conn through suring_maybe_destroy().
+ */
+static void suring_kill(struct conn *c) {
+    if (!c->dead) {
+        c->dead = true;
+        printf("Disconnecting\n");
+        shutdown(c->fd, SHUT_RDWR);
+    }
+}
+
+/**
+ * @brief Submit the unsent part of the write queue as a single sendmsg.
+ */
+static void start_send(struct suring *loop, struct conn *c) {
+    if (c->dead || c->sends_inflight > 0) {
+        return;
+    }
+
+    int n = conn_pending_iov(c, c->send_iov, CONN_MAX_IOV);
+    if (n == 0) {
+        if (c->closing) {
+            suring_kill(c);
+        }
+        return;
+    }
+
+    struct io_uring_sqe *sqe = ring_get_sqe(&loop->ring);
+    if (!sqe) {
+        defer(loop, c, RETRY_SEND);
+        return;
+    }
+    memset(&c->send_msg, 0, sizeof(c->send_msg));
+    c->send_msg.msg_iov = c->send_iov;
+    c->send_msg.msg_iovlen = (size_t)n;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = c->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&c->send_msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = tag(c, OP_SEND);
+    c->sends_inflight = 1;
+}
+
+/**
+ * @brief Issue the operations that earlier found the submission queue full.
+ * Called after each submit, which has just handed the whole queue over.
+ */
+static void retry_pending(struct suring *loop) {
+    unsigned retry = loop->retry;
+    loop->retry = 0;
+    if ((retry & RETRY_ACCEPT) && *loop->running) {
+        arm_accept(loop);
+    }
+    if ((retry & RETRY_BACKOFF) && *loop->running) {
+        arm_accept_later(loop);
+    }
+    if (retry & RETRY_WAKE) {
+        arm_wake(loop);
+    }
+
+    // Whatever fails again is deferred onto a fresh list for the next round
+    struct conn *c = loop->retries;
+    loop->retries = NULL;
+    while (c) {
+        struct conn *next = c->retry_next;
+        retry = c->retry;
+        c->retry = 0;
+        if (!c->dead) {
+            if ((retry & RETRY_CANCEL) && c->recv_armed && c->read_blocked) {
+                cancel_recv(loop, c);
+            }
+            if ((retry & RETRY_RECV) && !c->recv_armed && !c->closing && !c->read_blocked) {
+                arm_recv(loop, c);
+            }
+            if (retry & RETRY_SEND) {
+                start_send(loop, c);
+            }
+        }
+        suring_maybe_destroy(loop, c);
+        c = next;
+    }
+}
+
+// COMPLETIONS ==============================================
+
+static void on_accept(struct suring *loop, struct io_uring_cqe *cqe) {
+    bool rearm = !(cqe->flags & IORING_CQE_F_MORE) && *loop->running;
+    if (cqe->res < 0) {
+        if (!loop->accept_failing) {
+            fprintf(stderr, "Accept failed: %s\n", strerror(-cqe->res));
+            loop->accept_failing = true;
+        }
+        if (rearm) {
+            if (cqe->res == -EMFILE || cqe->res == -ENFILE || cqe->res == -ENOMEM || cqe->res == -ENOBUFS) {
+                arm_accept_later(loop);
+            } else {
+                arm_accept(loop);
+            }
+        }
+        return;
+    }
+    loop->accept_failing = false;
+    if (rearm) {
+        arm_accept(loop);
+    }
+
+    struct conn *c = conn_create(cqe->res);
+    if (!c) {
+        close(cqe->res);
+        return;
+    }
+    c->next = loop->conns;
+    if (loop->conns) {
+        loop->conns->prev = c;
+    }
+    loop->conns = c;
+
+    struct sockaddr_in address;
+    socklen_t addrlen = sizeof(address);
+    if (getpeername(c->fd, (struct sockaddr *)&address, &addrlen) == 0) {
+        printf("Connection accepted from %s:%d\n", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+    }
+
+    arm_recv(loop, c);
+}
+
+static void on_recv(struct suring *loop, struct conn *c, struct io_uring_cqe *cqe) {
+    c->recv_armed = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        enum conn_action action = CONN_RESPOND;
+        if (!c->dead && !c->closing) {
+            action = conn_feed(c, loop->buf_mem + (size_t)bid * SURING_BUF_SIZE, (size_t)cqe->res, loop->handler, loop->ctx);
+        }
+        bufs_recycle(loop, bid);
+
+        if (action == CONN_SHUTDOWN) {
+            *loop->running = 0;
+            if (loop->wake_fd >= 0) {
+                eventfd_write(loop->wake_fd, 1);
+            }
+        }
+        if (action != CONN_RESPOND) {
+            suring_kill(c);
+            suring_maybe_destroy(loop, c);
+            return;
+        }
+
+        start_send(loop, c);
+        if (c->out_bytes >= CONN_MAX_PENDING && c->recv_armed && !c->read_blocked) {
+            // Apply backpressure: let the client wait until it has read what we owe it
+            c->read_blocked = true;
+            cancel_recv(loop, c);
+        }
+    } else if (cqe->res == 0) {
+        if (!c->dead) {
+            // The client has closed its side; finish sending what we owe it.
+            printf("Client disconnected.\n");
+            c->closing = true;
+            if (!conn_has_output(c)) {
+                suring_kill(c);
+            }
+        }
+    } else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+        if (!c->dead) {
+            fprintf(stderr, "recv failed: %s\n", strerror(-cqe->res));
+        }
+        suring_kill(c);
+    }
+
+    // Multishot recv stops on its own now and then (e.g. out of buffers)
+    if (!c->recv_armed && !c->dead && !c->closing && !c->read_blocked) {
+        arm_recv(loop, c);
+    }
+    suring_maybe_destroy(loop, c);
+}
+
+static void on_send(struct suring *loop, struct conn *c, struct io_uring_cqe *cqe) {
+    c->sends_inflight--;
+
+    if (cqe->res > 0) {
+        // A short write just leaves the rest for the next sendmsg
+        conn_consume(c, (size_t)cqe->res);
+    } else if (cqe->res < 0 && cqe->res != -ECANCELED) {
+        if (!c->dead) {
+            fprintf(stderr, "send failed: %s\n", strerror(-cqe->res));
+        }
+        suring_kill(c);
+    }
+
+    if (c->sends_inflight == 0 && !c->dead) {
+        // Output drained enough: start reading again
+        if (c->read_blocked && c->out_bytes < CONN_MAX_PENDING) {
+            c->read_blocked = false;
+            if (!c->recv_armed) {
+                arm_recv(loop, c);
+            }
+        }
+        start_send(loop, c);
+    }
+    suring_maybe_destroy(loop, c);
+}
+
+static void handle_cqe(struct suring *loop, struct io_uring_cqe *cqe) {
+    uint64_t op = cqe->user_data & OP_MASK;
+    struct conn *c = (struct conn *)(uintptr_t)(cqe->user_data & ~OP_MASK);
+
+    switch (op) {
+        case OP_ACCEPT:
+            on_accept(loop, cqe);
+            break;
+        case OP_RECV:
+            on_recv(loop, c, cqe);
+            break;
+        case OP_SEND:
+            on_send(loop, c, cqe);
+            break;
+        case OP_WAKE:
+            break;  // Only here to end the wait; *running says why
+        case OP_BACKOFF:
+            if (*loop->running) {
+                arm_accept(loop);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// FEATURE PROBE ============================================
+
+/**
+ * @brief Check that the kernel has every operation the loop issues.
+ */
+static int probe_ops(struct ring *r) {
+    static const unsigned char needed[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL,
+        IORING_OP_TIMEOUT,
+    };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, size);
+    if (!probe) {
+        return -1;
+    }
+    int ret = sys_io_uring_register(r->fd, IORING_REGISTER_PROBE, probe, 256);
+    for (size_t i = 0; ret == 0 && i < sizeof(needed); i++) {
+        if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+            ret = -1;
+        }
+    }
+    free(probe);
+    return ret;
+}
+
+/**
+ * @brief Run one multishot recv into a provided buffer, on a socketpair with
+ * a byte and then EOF already waiting.
+ *
+ * Kernels that take the ring and the buffer registration but predate
+ * multishot recv (or multishot accept, which came just before it) only say
+ * so with -EINVAL on the first recv, which would fail every connection.
+ *
+ * @return int 0 if the byte arrived, or -1
+ */
+static int probe_multishot_recv(struct suring *loop) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("socketpair failed");
+        return -1;
+    }
+    int first = -EINVAL;
+    struct io_uring_sqe *sqe = ring_get_sqe(&loop->ring);
+    if (sqe && write(sv[1], "", 1) == 1 && shutdown(sv[1], SHUT_WR) == 0) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+        sqe->user_data = tag(NULL, OP_PROBE);
+
+        // Wait for the last completion, so nothing still points at the sockets
+        bool seen = false, more = true;
+        while (more) {
+            int ret = ring_submit(&loop->ring, 1);
+            if (ret < 0 && ret != -EINTR) {
+                first = ret;
+                break;
+            }
+            unsigned head = *loop->ring.cq_head;
+            unsigned tail = __atomic_load_n(loop->ring.cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail && more; head++) {
+                struct io_uring_cqe *cqe = &loop->ring.cqes[head & *loop->ring.cq_mask];
+                if (!seen) {
+                    first = cqe->res;
+                    seen = true;
+                }
+                if (cqe->flags & IORING_CQE_F_BUFFER) {
+                    bufs_recycle(loop, (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+                }
+                more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+            }
+            __atomic_store_n(loop->ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return first == 1 ? 0 : -1;
+}
+
+int suring_run(int listen_fd, int wake_fd, request_handler handler, void *ctx, volatile sig_atomic_t *running) {
+    struct suring loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.listen_fd = listen_fd;
+    loop.wake_fd = wake_fd;
+    loop.handler = handler;
+    loop.ctx = ctx;
+    loop.running = running;
+
+    if (ring_setup(&loop.ring, SURING_ENTRIES) < 0) {
+        return -1;
+    }
+    if (bufs_setup(&loop) < 0) {
+        ring_teardown(&loop.ring);
+        return -1;
+    }
+    if (probe_ops(&loop.ring) < 0 || probe_multishot_recv(&loop) < 0) {
+        fprintf(stderr, "io_uring lacks multishot accept/recv or a needed operation\n");
+        ring_teardown(&loop.ring);
+        bufs_teardown(&loop);
+        return -1;
+    }
+
+    arm_accept(&loop);
+    if (wake_fd >= 0) {
+        arm_wake(&loop);
+    }
+
+    while (*running) {
+        // One syscall both submits everything queued and waits for work;
+        // with operations left to retry, only submit to make room for them
+        bool retrying = loop.retry || loop.retries;
+        int ret = ring_submit(&loop.ring, retrying ? 0 : 1);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            fprintf(stderr, "io_uring_enter failed: %s\n", strerror(-ret));
+            break;
+        }
+        if (retrying) {
+            retry_pending(&loop);
+        }
+
+        unsigned head = *loop.ring.cq_head;
+        unsigned tail = __atomic_load_n(loop.ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail && *running) {
+            handle_cqe(&loop, &loop.ring.cqes[head & *loop.ring.cq_mask]);
+            head++;
+            __atomic_store_n(loop.ring.cq_head, head, __ATOMIC_RELEASE);
+            if (head == tail) {
+                tail = __atomic_load_n(loop.ring.cq_tail, __ATOMIC_ACQUIRE);
+            }
+        }
+    }
+
+    // Closing the ring cancels everything still in flight; only then is it
+    // safe to free the connections and buffers those operations point at
+    ring_teardown(&loop.ring);
+    while (loop.conns) {
+        struct conn *c = loop.conns;
+        loop.conns = c->next;
+        conn_destroy(c);
+    }
+    bufs_teardown(&loop);
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef SURING_H
+#define SURING_H
+
+/**
+ * @file suring.h
+ * @brief io_uring I/O backend for sserver.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-03-21
+ *
+ * Talks to the kernel through the raw io_uring syscalls (no liburing).
+ * Connections are accepted with one multishot accept, read with multishot
+ * recv into a ring of provided buffers, and answered with one sendmsg per
+ * connection covering its whole write queue, so a busy loop costs one
+ * io_uring_enter() per batch of requests instead of a recv() and a send()
+ * per request.
+ */
+
+#include <signal.h>
+
+#include "sconn.h"
+
+// Submission queue depth (the completion queue is four times larger)
+#define SURING_ENTRIES 4096
+
+// Provided receive buffers: count (power of two) and size of each
+#define SURING_NUM_BUFS 1024
+#define SURING_BUF_SIZE CONN_RECV_CHUNK
+
+/**
+ * @brief Serve every connection accepted on listen_fd with io_uring until
+ * *running becomes zero or a handler asks for shutdown.
+ *
+ * Same contract as sevent_run(), including the shared wake_fd.
+ *
+ * @return int 0 on a clean exit, -1 if io_uring is unavailable or lacks
+ * multishot recv (e.g. an old kernel or a seccomp filter) and nothing was
+ * served.
+ */
+int suring_run(int listen_fd, int wake_fd, request_handler handler, void *ctx, volatile sig_atomic_t *running);
+
+#endif // SURING_H
@@ -0,0 +1,293 @@
+/**
+ * @file swire.c
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @brief Compact (v2) encoding of responses.
+ * @version 0.1
+ * @date 2025-04-28
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "swire.h"
+
+// Where the check sits in a v2 header; everything before it is summed
+#define CHECK_OFFSET 20
+
+// Bytes of the page that ends the payload of a paged response
+#define PAGE_BYTES 12
+
+// Fewest payload bytes a record can take (every string empty)
+#define MIN_TRACK_BYTES (3 + 4 + 10 * 4 + 4)
+#define MIN_ALBUM_BYTES (2 + 8)
+#define MIN_PLAYLIST_BYTES 4
+
+static unsigned char *put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+    return p + 4;
+}
+
+static unsigned char *put_u64(unsigned char *p, uint64_t v) {
+    p = put_u32(p, (uint32_t)v);
+    return put_u32(p, (uint32_t)(v >> 32));
+}
+
+static unsigned char *put_f32(unsigned char *p, float f) {
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return put_u32(p, v);
+}
+
+/**
+ * @brief Length of a string field of cap bytes as sent (a str holds at most 255).
+ */
+static size_t str_len(const char *s, size_t cap) {
+    size_t n = strnlen(s, cap);
+    return n > 255 ? 255 : n;
+}
+
+static unsigned char *put_str(unsigned char *p, const char *s, size_t cap) {
+    size_t n = str_len(s, cap);
+    *p++ = (unsigned char)n;
+    memcpy(p, s, n);
+    return p + n;
+}
+
+static uint32_t sum_bytes(const unsigned char *p, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; i++) {
+        seed += p[i];
+    }
+    return seed;
+}
+
+#define STR(rec, field) (rec).field, sizeof((rec).field)
+
+size_t wire_v2_size(const struct response_msg *resp) {
+    size_t size = WIRE_V2_HEADER_SIZE;
+    if (resp->header.status == ERROR) {
+        return size + 1 + str_len(resp->error_message, sizeof(resp->error_message));
+    }
+    for (int i = 0; i < resp->header.num_tracks; i++) {
+        const struct track *t = &resp->data.tracks[i];
+        size += 3 + str_len(STR(*t, track_id)) + str_len(STR(*t, name)) + str_len(STR(*t, artist)) + 4 + 10 * 4 + 4;
+    }
+    for (int i = 0; i < resp->header.num_albums; i++) {
+        const struct album *a = &resp->data.albums[i];
+        size += 2 + str_len(STR(*a, album_id)) + str_len(STR(*a, name)) + 8;
+    }
+    for (int i = 0; i < resp->header.num_playlists; i++) {
+        const struct playlist *pl = &resp->data.playlists[i];
+        size += 4 + str_len(STR(*pl, playlist_id)) + str_len(STR(*pl, name)) + str_len(STR(*pl, genre)) +
+                str_len(STR(*pl, subgenre));
+    }
+    return resp->paged ? size + PAGE_BYTES : size;
+}
+
+void wire_v2_encode(const struct response_msg *resp, unsigned char *out) {
+    unsigned char *p = out + WIRE_V2_HEADER_SIZE;
+    if (resp->header.status == ERROR) {
+        p = put_str(p, resp->error_message, sizeof(resp->error_message));
+    } else {
+        for (int i = 0; i < resp->header.num_tracks; i++) {
+            const struct track *t = &resp->data.tracks[i];
+            p = put_str(p, STR(*t, track_id));
+            p = put_str(p, STR(*t, name));
+            p = put_str(p, STR(*t, artist));
+            p = put_u32(p, (uint32_t)t->popularity);
+            p = put_f32(p, t->danceability);
+            p = put_f32(p, t->energy);
+            p = put_f32(p, t->key);
+            p = put_f32(p, t->loudness);
+            p = put_f32(p, t->speechiness);
+            p = put_f32(p, t->acousticness);
+            p = put_f32(p, t->instrumentalness);
+            p = put_f32(p, t->liveness);
+            p = put_f32(p, t->valence);
+            p = put_f32(p, t->tempo);
+            p = put_u32(p, (uint32_t)t->duration_ms);
+        }
+        for (int i = 0; i < resp->header.num_albums; i++) {
+            const struct album *a = &resp->data.albums[i];
+            p = put_str(p, STR(*a, album_id));
+            p = put_str(p, STR(*a, name));
+            p = put_u64(p, (uint64_t)(int64_t)a->release_date);
+        }
+        for (int i = 0; i < resp->header.num_playlists; i++) {
+            const struct playlist *pl = &resp->data.playlists[i];
+            p = put_str(p, STR(*pl, playlist_id));
+            p = put_str(p, STR(*pl, name));
+            p = put_str(p, STR(*pl, genre));
+            p = put_str(p, STR(*pl, subgenre));
+        }
+        if (resp->paged) {
+            p = put_u32(p, resp->page.total);
+            p = put_u32(p, resp->page.first);
+            p = put_u32(p, resp->page.next_cursor);
+        }
+    }
+
+    int error = resp->header.status == ERROR;
+    size_t payload_len = (size_t)(p - out) - WIRE_V2_HEADER_SIZE;
+    unsigned char *h = out;
+    h[0] = PROTOCOL_V2;
+    h[1] = (unsigned char)resp->header.status;
+    h[2] = !error && resp->paged ? WIRE_V2_PAGED : 0;
+    h[3] = 0;
+    h = put_u32(h + 4, error ? 0 : (uint32_t)resp->header.num_tracks);
+    h = put_u32(h, error ? 0 : (uint32_t)resp->header.num_albums);
+    h = put_u32(h, error ? 0 : (uint32_t)resp->header.num_playlists);
+    h = put_u32(h, (uint32_t)payload_len);
+    uint32_t check = sum_bytes(out, CHECK_OFFSET, 1337);
+    put_u32(h, sum_bytes(out + WIRE_V2_HEADER_SIZE, payload_len, check));
+}
+
+/**
+ * @brief A cursor over received bytes; reading past the end sets bad.
+ */
+struct reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    int bad;
+};
+
+static uint32_t get_u32(struct reader *r) {
+    if (r->end - r->p < 4) {
+        r->bad = 1;
+        return 0;
+    }
+    uint32_t v = (uint32_t)r->p[0] | (uint32_t)r->p[1] << 8 | (uint32_t)r->p[2] << 16 | (uint32_t)r->p[3] << 24;
+    r->p += 4;
+    return v;
+}
+
+static uint64_t get_u64(struct reader *r) {
+    uint64_t lo = get_u32(r);
+    return lo | (uint64_t)get_u32(r) << 32;
+}
+
+static float get_f32(struct reader *r) {
+    uint32_t v = get_u32(r);
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief Copy a str into a zeroed field of cap bytes, which must have room for its terminator.
+ */
+static void get_str(struct reader *r, char *dst, size_t cap) {
+    if (r->p == r->end || (size_t)*r->p >= cap || (size_t)(r->end - r->p - 1) < *r->p) {
+        r->bad = 1;
+        return;
+    }
+    size_t n = *r->p++;
+    memcpy(dst, r->p, n);
+    r->p += n;
+}
+
+int wire_v2_decode_header(const unsigned char *in, struct response_header *h, uint32_t *payload_len) {
+    if (in[0] != PROTOCOL_V2 || in[1] > ERROR || (in[2] & ~WIRE_V2_PAGED) != 0) {
+        return -1;
+    }
+    struct reader r = { in + 4, in + WIRE_V2_HEADER_SIZE, 0 };
+    memset(h, 0, sizeof(*h));
+    h->status = (enum status_code)in[1];
+    h->num_tracks = (int)get_u32(&r);
+    h->num_albums = (int)get_u32(&r);
+    h->num_playlists = (int)get_u32(&r);
+    *payload_len = get_u32(&r);
+    h->check = get_u32(&r);
+    return h->num_tracks < 0 || h->num_albums < 0 || h->num_playlists < 0 ? -1 : 0;
+}
+
+int wire_v2_decode_payload(const unsigned char *header, const unsigned char *payload, uint32_t len,
+                           struct response_msg *resp) {
+    uint32_t check = sum_bytes(header, CHECK_OFFSET, 1337);
+    if (sum_bytes(payload, len, check) != resp->header.check) {
+        return -1;
+    }
+    resp->paged = (header[2] & WIRE_V2_PAGED) != 0;
+
+    // The page is at the end, after the records
+    struct reader r = { payload, payload + len, 0 };
+    if (resp->paged) {
+        if (len < PAGE_BYTES) {
+            return -1;
+        }
+        struct reader page = { payload + len - PAGE_BYTES, payload + len, 0 };
+        resp->page.total = get_u32(&page);
+        resp->page.first = get_u32(&page);
+        resp->page.next_cursor = get_u32(&page);
+        r.end -= PAGE_BYTES;
+        len -= PAGE_BYTES;
+    }
+    if (resp->header.status == ERROR) {
+        memset(resp->error_message, 0, sizeof(resp->error_message));
+        get_str(&r, resp->error_message, sizeof(resp->error_message));
+        return r.bad || r.p != r.end ? -1 : 0;
+    }
+
+    // The counts must fit the payload before anything is allocated for them
+    uint64_t least = (uint64_t)resp->header.num_tracks * MIN_TRACK_BYTES +
+                     (uint64_t)resp->header.num_albums * MIN_ALBUM_BYTES +
+                     (uint64_t)resp->header.num_playlists * MIN_PLAYLIST_BYTES;
+    resp->data.tracks = NULL;
+    resp->data.albums = NULL;
+    resp->data.playlists = NULL;
+    if (least > len) {
+        return -1;
+    }
+    struct track *tracks = (struct track *)calloc((size_t)resp->header.num_tracks + 1, sizeof(struct track));
+    struct album *albums = (struct album *)calloc((size_t)resp->header.num_albums + 1, sizeof(struct album));
+    struct playlist *playlists =
+        (struct playlist *)calloc((size_t)resp->header.num_playlists + 1, sizeof(struct playlist));
+    r.bad = !tracks || !albums || !playlists;
+
+    for (int i = 0; !r.bad && i < resp->header.num_tracks; i++) {
+        struct track *t = &tracks[i];
+        get_str(&r, STR(*t, track_id));
+        get_str(&r, STR(*t, name));
+        get_str(&r, STR(*t, artist));
+        t->popularity = (int)get_u32(&r);
+        t->danceability = get_f32(&r);
+        t->energy = get_f32(&r);
+        t->key = get_f32(&r);
+        t->loudness = get_f32(&r);
+        t->speechiness = get_f32(&r);
+        t->acousticness = get_f32(&r);
+        t->instrumentalness = get_f32(&r);
+        t->liveness = get_f32(&r);
+        t->valence = get_f32(&r);
+        t->tempo = get_f32(&r);
+        t->duration_ms = (int)get_u32(&r);
+    }
+    for (int i = 0; !r.bad && i < resp->header.num_albums; i++) {
+        struct album *a = &albums[i];
+        get_str(&r, STR(*a, album_id));
+        get_str(&r, STR(*a, name));
+        a->release_date = (time_t)(int64_t)get_u64(&r);
+    }
+    for (int i = 0; !r.bad && i < resp->header.num_playlists; i++) {
+        struct playlist *pl = &playlists[i];
+        get_str(&r, STR(*pl, playlist_id));
+        get_str(&r, STR(*pl, name));
+        get_str(&r, STR(*pl, genre));
+        get_str(&r, STR(*pl, subgenre));
+    }
+
+    if (r.bad || r.p != r.end) {
+        free(tracks);
+        free(albums);
+        free(playlists);
+        return -1;
+    }
+    resp->data.tracks = tracks;
+    resp->data.albums = albums;
+    resp->data.playlists = playlists;
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef SWIRE_H
+#define SWIRE_H
+
+/**
+ * @file swire.h
+ * @brief Compact (v2) encoding of responses.
+ * @author Chang Min Bark (cb073@bucknell.edu)
+ * @date 2025-04-28
+ *
+ * A v1 response is the header followed by the record structs exactly as they
+ * sit in memory, so every track costs sizeof(struct track) bytes however
+ * short its strings are. A v2 response is a frame of WIRE_V2_HEADER_SIZE
+ * bytes followed by a payload of packed records:
+ *
+ *   header   u8 version (2), u8 status, u8 flags, u8 zero, u32 num_tracks,
+ *            u32 num_albums, u32 num_playlists, u32 payload bytes, u32 check
+ *   track    str track_id, str name, str artist, i32 popularity,
+ *            f32 danceability .. tempo (10 of them), i32 duration_ms
+ *   album    str album_id, str name, i64 release_date
+ *   playlist str playlist_id, str name, str genre, str subgenre
+ *   error    str message (the whole payload)
+ *   page     u32 total, u32 first, u32 next_cursor (flags has WIRE_V2_PAGED)
+ *
+ * Integers and floats are little-endian; a str is a u8 length and that many
+ * bytes, with no terminator. Tracks come first, then albums, then playlists,
+ * as in v1, and the page of a paged response ends the payload. check is 1337
+ * plus every byte of the header (with check zero) and of the payload, modulo
+ * 2^32.
+ *
+ * A connection speaks v1 until the client sends SET_PROTOCOL with args "2";
+ * that request is still answered in v1, so a server that does not know the
+ * command refuses it in a form the client can read.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spotify.h"
+
+#define WIRE_V2_HEADER_SIZE 24
+
+// Header flag: the payload ends with a struct response_page
+#define WIRE_V2_PAGED 0x01
+
+/**
+ * @brief Bytes resp takes in v2, header included.
+ */
+size_t wire_v2_size(const struct response_msg *resp);
+
+/**
+ * @brief Write resp as a v2 frame of wire_v2_size(resp) bytes into out.
+ */
+void wire_v2_encode(const struct response_msg *resp, unsigned char *out);
+
+/**
+ * @brief Read a v2 header into h (the check field gets the frame's check).
+ *
+ * @param payload_len set to the number of payload bytes that follow
+ * @return int 0, or -1 if it is not a v2 header
+ */
+int wire_v2_decode_header(const unsigned char *in, struct response_header *h, uint32_t *payload_len);
+
+/**
+ * @brief Verify the frame's check, then unpack its payload into resp (whose
+ * header came from wire_v2_decode_header()). Records are zero-padded like
+ * the v1 structs; the caller frees the arrays as for a v1 response.
+ *
+ * @return int 0, or -1 if the check does not match or the payload is malformed
+ */
+int wire_v2_decode_payload(const unsigned char *header, const unsigned char *payload, uint32_t len,
+                           struct response_msg *resp);
+
+#endif // SWIRE_H